@@ -0,0 +1,83 @@
+; Benchmark: bubble sort no pior caso
+; Entrada: LEN REP (LEN <= 100). Preenche V com LEN..1 e ordena, REP vezes;
+; mostra V[0], V[1] e V[99].
+; Sem endereçamento indireto: P e Q guardam os endereços de V[j] e V[j+1] e
+; são copiados para os operandos das instruções que acessam o vetor
+; (código automodificável). Os números são os endereços desses operandos
+; (ver bubble.map): 20 em PUT, 61 em A1, 63 em A2, 81 (fonte) em S1,
+; 84 e 85 em S2 e 88 (destino) em S3.
+
+SECAO TEXTO
+        INPUT LEN
+        INPUT REP
+        COPY 20, BASE           ; BASE = endereço de V
+EXT:    COPY BASE, P            ; preenche V com LEN..1
+        LOAD LEN
+        STORE X
+FILL:   COPY P, 20
+        LOAD X
+PUT:    STORE V
+        LOAD P
+        ADD ONE
+        STORE P
+        LOAD X
+        SUB ONE
+        STORE X
+        JMPP FILL
+        LOAD LEN
+        SUB ONE
+        STORE K                 ; passadas K = LEN-1 .. 1
+PASS:   COPY BASE, P
+        LOAD BASE
+        ADD ONE
+        STORE Q
+        LOAD K
+        STORE J
+CMP:    COPY P, 61
+        COPY Q, 63
+A1:     LOAD V                  ; V[j] - V[j+1]
+A2:     SUB V
+        JMPN NEXT
+        JMPZ NEXT
+        COPY P, 81              ; troca V[j] e V[j+1]
+        COPY Q, 84
+        COPY P, 85
+        COPY Q, 88
+S1:     COPY V, T
+S2:     COPY V, V
+S3:     COPY T, V
+NEXT:   LOAD Q
+        STORE P
+        ADD ONE
+        STORE Q
+        LOAD J
+        SUB ONE
+        STORE J
+        JMPP CMP
+        LOAD K
+        SUB ONE
+        STORE K
+        JMPP PASS
+        LOAD REP
+        SUB ONE
+        STORE REP
+        JMPP EXT
+        OUTPUT V
+        OUTPUT W
+        OUTPUT LAST
+        STOP
+
+SECAO DADOS
+LEN:    SPACE
+REP:    SPACE
+K:      SPACE
+J:      SPACE
+X:      SPACE
+P:      SPACE
+Q:      SPACE
+T:      SPACE
+BASE:   SPACE
+ONE:    CONST 1
+V:      SPACE
+W:      SPACE 98
+LAST:   SPACE
@@ -0,0 +1,30 @@
+; Benchmark: fatorial iterativo
+; Entrada: N REP. Calcula N! (N <= 12 cabe em 32 bits) REP vezes.
+
+SECAO TEXTO
+        INPUT N
+        INPUT REP
+EXT:    LOAD N
+        STORE I
+        LOAD ONE
+        STORE F
+FAT:    LOAD F          ; F = F * I, para I = N..1
+        MUL I
+        STORE F
+        LOAD I
+        SUB ONE
+        STORE I
+        JMPP FAT
+        LOAD REP
+        SUB ONE
+        STORE REP
+        JMPP EXT
+        OUTPUT F
+        STOP
+
+SECAO DADOS
+N:      SPACE
+REP:    SPACE
+I:      SPACE
+F:      SPACE
+ONE:    CONST 1
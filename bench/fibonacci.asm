@@ -0,0 +1,37 @@
+; Benchmark: Fibonacci iterativo
+; Entrada: N REP. Calcula fib(N) (N <= 46 cabe em 32 bits) REP vezes.
+
+SECAO TEXTO
+        INPUT N
+        INPUT REP
+EXT:    LOAD ZERO
+        STORE A
+        LOAD ONE
+        STORE B
+        LOAD N
+        STORE I
+FIB:    LOAD A          ; (A, B) = (B, A + B)
+        ADD B
+        STORE T
+        COPY B, A
+        COPY T, B
+        LOAD I
+        SUB ONE
+        STORE I
+        JMPP FIB
+        LOAD REP
+        SUB ONE
+        STORE REP
+        JMPP EXT
+        OUTPUT A
+        STOP
+
+SECAO DADOS
+N:      SPACE
+REP:    SPACE
+I:      SPACE
+A:      SPACE
+B:      SPACE
+T:      SPACE
+ZERO:   CONST 0
+ONE:    CONST 1
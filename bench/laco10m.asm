@@ -0,0 +1,16 @@
+; Benchmark patológico: laço mínimo de 4 instruções, só despacho e desvio
+; Entrada: N. Roda 4 * N + 3 passos (N = 2499999: 9999999, logo abaixo do
+; limite padrão de 10 milhões).
+
+SECAO TEXTO
+        INPUT N
+LOOP:   LOAD N
+        SUB ONE
+        STORE N
+        JMPP LOOP
+        OUTPUT N
+        STOP
+
+SECAO DADOS
+N:      SPACE
+ONE:    CONST 1
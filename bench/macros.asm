@@ -0,0 +1,74 @@
+; Benchmark: programa com muitas macros
+; Entrada: REP. Cada volta expande 12 macros em um único bloco reto de 52
+; instruções (bom caso para as superinstruções); A, B, C e D ficam < M.
+
+INC: MACRO X
+    LOAD X
+    ADD ONE
+    STORE X
+ENDMACRO
+
+ADDTO: MACRO X, Y
+    LOAD X
+    ADD Y
+    STORE X
+ENDMACRO
+
+SCALE: MACRO X, F
+    LOAD X
+    MUL F
+    STORE X
+ENDMACRO
+
+MODM: MACRO X
+    LOAD X
+    DIV M
+    MUL M
+    STORE TMP
+    LOAD X
+    SUB TMP
+    STORE X
+ENDMACRO
+
+SWAP: MACRO X, Y
+    COPY X, TMP
+    COPY Y, X
+    COPY TMP, Y
+ENDMACRO
+
+SECAO TEXTO
+        INPUT REP
+LOOP:
+        INC A
+        MODM A
+        ADDTO B, A
+        SCALE B, F3
+        MODM B
+        ADDTO C, B
+        SCALE C, F7
+        MODM C
+        SWAP A, C
+        ADDTO D, A
+        MODM D
+        SWAP B, D
+        LOAD REP
+        SUB ONE
+        STORE REP
+        JMPP LOOP
+        OUTPUT A
+        OUTPUT B
+        OUTPUT C
+        OUTPUT D
+        STOP
+
+SECAO DADOS
+REP:    SPACE
+A:      SPACE
+B:      SPACE
+C:      SPACE
+D:      SPACE
+TMP:    SPACE
+ONE:    CONST 1
+F3:     CONST 3
+F7:     CONST 7
+M:      CONST 10007
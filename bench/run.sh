@@ -0,0 +1,88 @@
+#!/bin/sh
+# Benchmark do simulador (make bench-sim).
+#
+# Uso: bench/run.sh [-r repetições] [carga ...]
+#
+# Monta cada bench/<carga>.asm, roda o programa com bench/<carga>.in em
+# todos os modos de MODES, confere a saída com bench/<carga>.out e imprime
+# em stdout um JSON com o melhor de r repetições (padrão 3) por carga e
+# modo. Os tempos vêm de "simulador --timing": início (carga, verificação
+# e preparação da Vm) e execução, da qual saem ns/instrução e passos/s.
+# O JSON traz o commit e a CPU, para comparar resultados entre commits.
+#
+# SIM e COMPILER trocam os executáveis (padrão ./simulador e ./compiler).
+
+SIM=${SIM:-./simulador}
+COMPILER=${COMPILER:-./compiler}
+DIR=$(dirname "$0")
+MAX_STEPS=100000000000
+
+# nome|opções|formato da imagem
+MODES="threaded|--engine=threaded|o2
+threaded-nofusion|--engine=threaded --no-fusion|o2
+threaded-noverify|--engine=threaded --no-verify|o2
+threaded-o2b|--engine=threaded|o2b
+switch|--engine=switch|o2
+jit|--engine=jit|o2"
+
+REPS=3
+while getopts r: opt; do
+  case $opt in
+    r) REPS=$OPTARG ;;
+    *) echo "Uso: $0 [-r repetições] [carga ...]" >&2; exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+if [ $# -eq 0 ]; then
+  set -- fatorial fibonacci soma_smc bubble macros laco10m
+fi
+
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+commit=$(git -C "$DIR" rev-parse --short HEAD 2>/dev/null || echo desconhecido)
+if [ "$commit" != desconhecido ] && ! git -C "$DIR" diff --quiet HEAD -- 2>/dev/null; then
+  commit="$commit-dirty"
+fi
+cpu=$(sed -n 's/^model name[[:space:]]*: //p' /proc/cpuinfo 2>/dev/null | head -n 1)
+[ -n "$cpu" ] || cpu=$(uname -m)
+
+printf '{\n  "commit": "%s",\n  "date": "%s",\n  "cpu": "%s",\n  "reps": %s,\n  "results": [' \
+  "$commit" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$cpu" "$REPS"
+sep=
+for w in "$@"; do
+  if ! "$COMPILER" "$DIR/$w.asm" > "$TMP/compile.log" 2>&1; then
+    cat "$TMP/compile.log" >&2
+    echo "Erro: não foi possível montar $DIR/$w.asm" >&2
+    exit 1
+  fi
+  echo "$MODES" | while IFS='|' read -r mode args ext; do
+    r=0
+    : > "$TMP/times"
+    while [ $r -lt "$REPS" ]; do
+      # shellcheck disable=SC2086
+      if ! "$SIM" "$DIR/$w.$ext" $args --max-steps=$MAX_STEPS --timing < "$DIR/$w.in" \
+           > "$TMP/out" 2> "$TMP/err" || ! cmp -s "$TMP/out" "$DIR/$w.out"; then
+        cat "$TMP/err" >&2
+        echo "Erro: $w ($mode): saída diferente de $DIR/$w.out" >&2
+        exit 1
+      fi
+      sed -n 's/^\[timing\] início \([0-9.]*\) ms, execução \([0-9.]*\) ms, \([0-9]*\) passos.*/\1 \2 \3/p' \
+        "$TMP/err" >> "$TMP/times"
+      r=$((r + 1))
+    done
+    # melhor de REPS: menor início e menor execução
+    awk -v w="$w" -v m="$mode" -v sep="$sep" '
+      NR == 1 || $1 < s { s = $1 }
+      NR == 1 || $2 < t { t = $2 }
+      { n = $3 }
+      END {
+        printf "%s\n    {\"workload\": \"%s\", \"mode\": \"%s\", \"steps\": %d, \"startup_ms\": %.3f, \"run_ms\": %.3f, \"ns_per_instr\": %.3f, \"steps_per_sec\": %.0f}",
+               sep, w, m, n, s, t, t * 1e6 / n, n / (t / 1e3)
+        printf "%-10s %-18s %8.3f ns/instr %12.0f passos/s  início %.3f ms\n", w, m, t * 1e6 / n, n / (t / 1e3), s > "/dev/stderr"
+      }' "$TMP/times" || exit 1
+    sep=,
+  done || exit 1
+  sep=,
+done
+printf '\n  ]\n}\n'
@@ -0,0 +1,57 @@
+; Benchmark: soma de vetor com endereços corrigidos no próprio código
+; Entrada: LEN REP. Preenche V[0..LEN-1] com 1..LEN e soma o vetor REP vezes.
+; Não há endereçamento indireto: o laço avança o operando da instrução que
+; acessa o vetor (código automodificável, então o verificador recusa a prova).
+; 22 e 51 são os endereços dos operandos de PUT e GET (ver soma_smc.map).
+
+SECAO TEXTO
+        INPUT LEN
+        INPUT REP
+        COPY 22, BASE           ; BASE = endereço de V
+        LOAD LEN
+        STORE I
+        LOAD ZERO
+        STORE X
+FILL:   LOAD X
+        ADD ONE
+        STORE X
+PUT:    STORE V                 ; V[LEN - I] = X
+        LOAD 22
+        ADD ONE
+        STORE 22
+        LOAD I
+        SUB ONE
+        STORE I
+        JMPP FILL
+EXT:    COPY BASE, 51
+        LOAD LEN
+        STORE I
+        LOAD ZERO
+        STORE S
+SUM:    LOAD S
+GET:    ADD V                   ; S = S + V[LEN - I]
+        STORE S
+        LOAD 51
+        ADD ONE
+        STORE 51
+        LOAD I
+        SUB ONE
+        STORE I
+        JMPP SUM
+        LOAD REP
+        SUB ONE
+        STORE REP
+        JMPP EXT
+        OUTPUT S
+        STOP
+
+SECAO DADOS
+LEN:    SPACE
+REP:    SPACE
+I:      SPACE
+X:      SPACE
+S:      SPACE
+BASE:   SPACE
+ZERO:   CONST 0
+ONE:    CONST 1
+V:      SPACE 1000
@@ -1,13 +1,25 @@
 #include "code_generator.h"
+#include "object_image.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <cctype>
+#include <algorithm>
 
-CodeGenerator::CodeGenerator(const std::vector<Instruction>& insts, SymbolTable& st)
+CodeGenerator::CodeGenerator(const InstructionArena& insts, SymbolTable& st)
     : instructions(insts), symbol_table(st) {
 }
 
+void CodeGenerator::onLabel(int symbol, int address) {
+    for (int slot : symbol_table.takeChain(symbol)) {
+        object_code[slot] = address;
+    }
+}
+
+void CodeGenerator::onInstruction(const Instruction& inst) {
+    generateInstructionCode(inst);
+}
+
 void CodeGenerator::generateIntermediateCode() {
     object_code.clear();
     
@@ -17,28 +29,20 @@ void CodeGenerator::generateIntermediateCode() {
 }
 
 void CodeGenerator::generateInstructionCode(const Instruction& inst) {
-    switch (inst.type) {
-        case InstructionType::SPACE: {
+    switch (ISA[inst.isa].cls) {
+        case ISA_SPACE: {
             // SPACE directive - add zeros
-            int count = 1;
-            if (!inst.operands.empty()) {
-                // Parse the count if provided
-                try {
-                    count = std::stoi(inst.operands[0]);
-                } catch (...) {
-                    count = 1;
-                }
-            }
+            int count = inst.size();
             for (int i = 0; i < count; i++) {
                 object_code.push_back(0);
             }
             break;
         }
         
-        case InstructionType::CONST: {
+        case ISA_CONST: {
             // CONST directive - add the constant value
-            if (!inst.operands.empty()) {
-                int value = resolveOperand(inst.operands[0]);
+            if (inst.n_operands > 0) {
+                int value = resolveOperand(inst, 0, object_code.size());
                 object_code.push_back(value);
             } else {
                 object_code.push_back(0);
@@ -46,73 +50,31 @@ void CodeGenerator::generateInstructionCode(const Instruction& inst) {
             break;
         }
         
-        case InstructionType::STOP: {
-            // STOP has no operands
-            object_code.push_back(inst.opcode);
-            break;
-        }
-        
-        case InstructionType::COPY: {
-            // COPY has two operands
-            object_code.push_back(inst.opcode);
-            if (inst.operands.size() >= 2) {
-                int addr1 = resolveOperand(inst.operands[0]);
-                int addr2 = resolveOperand(inst.operands[1]);
-                object_code.push_back(addr1);
-                object_code.push_back(addr2);
-            } else {
-                object_code.push_back(-1);
-                object_code.push_back(-1);
-            }
-            break;
-        }
-        
         default: {
-            // Most instructions have one operand
-            object_code.push_back(inst.opcode);
-            if (!inst.operands.empty()) {
-                int addr = resolveOperand(inst.operands[0]);
-                object_code.push_back(addr);
-            } else {
-                object_code.push_back(-1);
+            // Machine instruction: opcode, then its operands (isa.h)
+            object_code.push_back(inst.opcode());
+            for (int k = 0; k < ISA[inst.isa].operands; k++) {
+                if (k < inst.n_operands) {
+                    int addr = resolveOperand(inst, k, object_code.size());
+                    object_code.push_back(addr);
+                } else {
+                    object_code.push_back(-1);
+                }
             }
             break;
         }
     }
 }
 
-int CodeGenerator::resolveOperand(const std::string& operand) {
-    // Check if it's a number
-    if (!operand.empty() && (std::isdigit(operand[0]) || 
-        operand[0] == '-' || operand[0] == '+')) {
-        
-        // Handle hex numbers
-        if (operand.find("0X") != std::string::npos || 
-            operand.find("0x") != std::string::npos) {
-            try {
-                return std::stoi(operand, nullptr, 16);
-            } catch (...) {
-                return 0;
-            }
-        }
-        
-        // Handle decimal numbers
-        try {
-            return std::stoi(operand);
-        } catch (...) {
-            return 0;
-        }
-    }
-    
-    // It's a symbol - look it up in the symbol table
-    if (symbol_table.isSymbolDefined(operand)) {
-        return symbol_table.getSymbolAddress(operand);
+int CodeGenerator::resolveOperand(const Instruction& inst, int k, int slot) {
+    // Symbols were interned by the lexer: their address, or -1 until the
+    // slot is backpatched
+    if (inst.isSymbol(k)) {
+        return symbol_table.reference(inst.operand[k], slot);
     }
     
-    // Symbol not defined - add pending reference
-    int current_pos = object_code.size();
-    symbol_table.addPendingReference(current_pos, operand, 0);
-    return -1;  // Placeholder for pending reference
+    // Otherwise it's a number, parsed by the lexer
+    return inst.operand[k];
 }
 
 void CodeGenerator::writeIntermediateCode(const std::string& filename) {
@@ -121,16 +83,21 @@ void CodeGenerator::writeIntermediateCode(const std::string& filename) {
         throw std::runtime_error("Cannot open file for writing: " + filename);
     }
     
+    // Slots still waiting for a symbol, indexed by address
+    std::vector<PendingReference> pending = symbol_table.getPendingReferences();
+    std::vector<const std::string*> pending_at(object_code.size(), nullptr);
+    for (const auto& ref : pending) {
+        if (ref.instruction_address < (int)object_code.size() && !pending_at[ref.instruction_address]) {
+            pending_at[ref.instruction_address] = &ref.symbol_name;
+        }
+    }
+    
     // Write the intermediate code with annotations for pending references
     for (size_t i = 0; i < object_code.size(); i++) {
         out << object_code[i];
         
-        // Check if this position has a pending reference
-        for (const auto& ref : symbol_table.getPendingReferences()) {
-            if (ref.instruction_address == i) {
-                out << " ; Pending: " << ref.symbol_name;
-                break;
-            }
+        if (pending_at[i]) {
+            out << " ; Pending: " << *pending_at[i];
         }
         
         if (i < object_code.size() - 1) {
@@ -155,14 +122,8 @@ void CodeGenerator::generateFinalCode() {
         generateIntermediateCode();
     }
     
-    // Resolve all pending references
-    auto resolutions = symbol_table.resolvePendingReferences();
-    
-    for (const auto& resolution : resolutions) {
-        if (resolution.first < object_code.size()) {
-            object_code[resolution.first] = resolution.second;
-        }
-    }
+    // Defined symbols were backpatched as they appeared; slots of undefined
+    // symbols keep -1
 }
 
 void CodeGenerator::writeFinalCode(const std::string& filename) {
@@ -178,3 +139,90 @@ void CodeGenerator::writeFinalCode(const std::string& filename) {
     
     out.close();
 }
+
+int CodeGenerator::getCodeEnd() const {
+    // Code ends after the last machine instruction; SPACE/CONST are data
+    int code_end = 0;
+    int address = 0;
+    for (const auto& inst : instructions) {
+        address += inst.size();
+        if (inst.opcode() != 0) {
+            code_end = std::max(code_end, address);
+        }
+    }
+    return code_end;
+}
+
+static void putLittleEndian(std::string& buffer, uint32_t value, int bytes) {
+    for (int b = 0; b < bytes; b++) {
+        buffer.push_back((char)((value >> (8 * b)) & 0xFF));
+    }
+}
+
+void CodeGenerator::writeBinaryCode(const std::string& filename) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Cannot open file for writing: " + filename);
+    }
+    
+    std::vector<int32_t> words(object_code.begin(), object_code.end());
+    
+    // Serialize field by field so the file is little-endian on any host
+    std::string image;
+    image.reserve(sizeof(O2bHeader) + 4 * words.size());
+    image.append(O2B_MAGIC, 4);
+    putLittleEndian(image, O2B_VERSION, 2);
+    putLittleEndian(image, sizeof(O2bHeader), 2);
+    putLittleEndian(image, words.size(), 4);
+    putLittleEndian(image, getCodeEnd(), 4);
+    putLittleEndian(image, 0, 4);  // programs start at address 0
+    putLittleEndian(image, o2bChecksum(words.data(), words.size()), 4);
+    for (int32_t w : words) {
+        putLittleEndian(image, (uint32_t)w, 4);
+    }
+    
+    out.write(image.data(), image.size());
+    out.close();
+}
+
+void CodeGenerator::writeLineMap(const std::string& filename, const SourceBuffer& source) {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        throw std::runtime_error("Cannot open file for writing: " + filename);
+    }
+    
+    // One entry per instruction or directive: address, size in words,
+    // line in the preprocessed source and that line's text
+    out << "; address size line source\n";
+    int address = 0;
+    for (const auto& inst : instructions) {
+        int size = inst.size();
+        address += size;
+        if (inst.isa == ISA_INVALID || size <= 0) {
+            continue;
+        }
+        out << address - size << " " << size << " " << inst.line_number << " ";
+        if (inst.line_number >= 1 && inst.line_number <= (int)source.lineCount()) {
+            // The line's text, trimmed, written straight from the buffer
+            const char* text = source.lineData(inst.line_number - 1);
+            size_t length = source.lineLength(inst.line_number - 1);
+            while (length > 0 && (*text == ' ' || *text == '\t' || *text == '\r')) {
+                text++;
+                length--;
+            }
+            while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t' ||
+                                  text[length - 1] == '\r')) {
+                length--;
+            }
+            out.write(text, length);
+        }
+        out << "\n";
+    }
+    
+    // Labels, for tools that accept LABEL or LABEL+N instead of an address
+    for (const auto& sym : symbol_table.getDefinedSymbols()) {
+        out << "sym " << sym.first << " " << sym.second << "\n";
+    }
+    
+    out.close();
+}
@@ -5,21 +5,31 @@
 #include <vector>
 #include "parser.h"
 #include "symbol_table.h"
+#include "source_buffer.h"
 
-class CodeGenerator {
+// Emits object code. Attached to the parser (Parser::setListener), it
+// assembles in one pass: each instruction is emitted as soon as it is parsed,
+// an operand naming a symbol that is not defined yet joins the symbol's
+// backpatch chain, and the chain is patched when the label appears.
+class CodeGenerator : public ParseListener {
 private:
-    const std::vector<Instruction>& instructions;
+    const InstructionArena& instructions;
     SymbolTable& symbol_table;
     std::vector<int> object_code;
     
     // Helper functions
-    int resolveOperand(const std::string& operand);
+    int resolveOperand(const Instruction& inst, int k, int slot);
     void generateInstructionCode(const Instruction& inst);
+    int getCodeEnd() const;
     
 public:
-    CodeGenerator(const std::vector<Instruction>& insts, SymbolTable& st);
+    CodeGenerator(const InstructionArena& insts, SymbolTable& st);
     
-    // Generate intermediate code with pending references (.o1)
+    // One-pass assembly (ParseListener)
+    void onLabel(int symbol, int address) override;
+    void onInstruction(const Instruction& inst) override;
+    
+    // Two-pass alternative: emit all parsed instructions at once (.o1)
     void generateIntermediateCode();
     void writeIntermediateCode(const std::string& filename);
     
@@ -27,6 +37,12 @@ public:
     void generateFinalCode();
     void writeFinalCode(const std::string& filename);
     
+    // Write final object code as a binary image (.o2b)
+    void writeBinaryCode(const std::string& filename);
+    
+    // Write the address -> source line map (.map) used by the simulator's profiler
+    void writeLineMap(const std::string& filename, const SourceBuffer& source);
+    
     const std::vector<int>& getObjectCode() const { return object_code; }
 };
 
@@ -1,31 +1,16 @@
 #include <iostream>
 #include <fstream>
+#include <utility>
 #include <vector>
 #include <string>
 #include <stdexcept>
 #include <algorithm>
 #include "lexer.h"
+#include "source_buffer.h"
 #include "preprocessor.h"
 #include "parser.h"
 #include "code_generator.h"
 
-std::vector<std::string> readFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        throw std::runtime_error("Cannot open input file: " + filename);
-    }
-    
-    std::vector<std::string> lines;
-    std::string line;
-    
-    while (std::getline(file, line)) {
-        lines.push_back(line);
-    }
-    
-    file.close();
-    return lines;
-}
-
 std::string getBaseName(const std::string& filename) {
     size_t lastDot = filename.find_last_of('.');
     if (lastDot != std::string::npos) {
@@ -46,21 +31,25 @@ int main(int argc, char* argv[]) {
     try {
         // Step 1: Read the input file
         std::cout << "Reading " << input_file << "...\n";
-        std::vector<std::string> lines = readFile(input_file);
+        SourceBuffer source = SourceBuffer::fromFile(input_file);
         
-        // Step 2: Preprocessing (macro expansion)
+        // Step 2: Preprocessing (macro expansion). The preprocessor takes
+        // over the source; later stages read its output buffer in place
         std::cout << "Preprocessing...\n";
-        Preprocessor preprocessor(lines);
-        std::vector<std::string> preprocessed_lines = preprocessor.preprocess();
+        Preprocessor preprocessor(std::move(source));
+        const SourceBuffer& preprocessed = preprocessor.preprocess();
         
         // Write .pre file
         std::string pre_file = base_name + ".pre";
         preprocessor.writeToFile(pre_file);
         std::cout << "Generated " << pre_file << "\n";
         
-        // Step 3: Parse the preprocessed code
+        // Step 3: Parse the preprocessed code, emitting object code in the
+        // same pass (forward references are backpatched)
         std::cout << "Parsing...\n";
-        Parser parser(preprocessed_lines);
+        Parser parser(preprocessed);
+        CodeGenerator generator(parser.getInstructions(), parser.getSymbolTable());
+        parser.setListener(&generator);
         parser.parse();
         
         // Check for errors
@@ -79,10 +68,8 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         
-        // Step 4: Generate intermediate code (.o1)
+        // Step 4: Intermediate code (.o1), already generated while parsing
         std::cout << "Generating intermediate code...\n";
-        CodeGenerator generator(parser.getInstructions(), parser.getSymbolTable());
-        generator.generateIntermediateCode();
         
         // Write .o1 file
         std::string o1_file = base_name + ".o1";
@@ -98,6 +85,16 @@ int main(int argc, char* argv[]) {
         generator.writeFinalCode(o2_file);
         std::cout << "Generated " << o2_file << "\n";
         
+        // Write .o2b file (binary image for fast loading)
+        std::string o2b_file = base_name + ".o2b";
+        generator.writeBinaryCode(o2b_file);
+        std::cout << "Generated " << o2b_file << "\n";
+        
+        // Write .map file (address -> .pre line, for profiling)
+        std::string map_file = base_name + ".map";
+        generator.writeLineMap(map_file, preprocessed);
+        std::cout << "Generated " << map_file << "\n";
+        
         // Check for unresolved symbols
         std::vector<std::string> undefined = parser.getSymbolTable().getUndefinedSymbols();
         if (!undefined.empty()) {
@@ -112,6 +109,8 @@ int main(int argc, char* argv[]) {
         std::cout << "  " << pre_file << " - Preprocessed code\n";
         std::cout << "  " << o1_file << " - Intermediate code\n";
         std::cout << "  " << o2_file << " - Final object code\n";
+        std::cout << "  " << o2b_file << " - Binary object image\n";
+        std::cout << "  " << map_file << " - Address to source line map\n";
         
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
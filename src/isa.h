@@ -0,0 +1,134 @@
+#ifndef ISA_H
+#define ISA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The SB instruction set and the assembler directives, in the one table
+// the compiler (lexer, parser, code generator) and the VM tools read.
+// Machine instructions come first, each at the index equal to its opcode,
+// so ISA[op] describes opcode op; entry 0 stands for an unknown opcode.
+// Directives follow with opcode 0.
+
+// What an entry does, for code that handles entries generically
+enum IsaClass {
+    ISA_UNKNOWN,
+    ISA_ARITH,     // ACC op= mem[a]
+    ISA_READ,      // reads mem[a] (LOAD, OUTPUT)
+    ISA_WRITE,     // writes the word named by its last operand (STORE, INPUT, COPY)
+    ISA_JUMP,      // always jumps to a
+    ISA_BRANCH,    // jumps to a or falls through
+    ISA_STOP,
+    ISA_SPACE,     // directives from here on
+    ISA_CONST,
+    ISA_SECTION,
+    ISA_MACRO,
+    ISA_ENDMACRO
+};
+
+struct IsaEntry {
+    const char* mnemonic;  // Upper case; source may use any case
+    int opcode;            // 0 for directives
+    int size;              // Words emitted (SPACE: when no count is given)
+    int operands;          // Operand count (SPACE: optional)
+    IsaClass cls;
+};
+
+static constexpr IsaEntry ISA[] = {
+    {"?",        0, 2, 1, ISA_UNKNOWN},
+    {"ADD",      1, 2, 1, ISA_ARITH},
+    {"SUB",      2, 2, 1, ISA_ARITH},
+    {"MUL",      3, 2, 1, ISA_ARITH},
+    {"DIV",      4, 2, 1, ISA_ARITH},
+    {"JMP",      5, 2, 1, ISA_JUMP},
+    {"JMPN",     6, 2, 1, ISA_BRANCH},
+    {"JMPP",     7, 2, 1, ISA_BRANCH},
+    {"JMPZ",     8, 2, 1, ISA_BRANCH},
+    {"COPY",     9, 3, 2, ISA_WRITE},
+    {"LOAD",    10, 2, 1, ISA_READ},
+    {"STORE",   11, 2, 1, ISA_WRITE},
+    {"INPUT",   12, 2, 1, ISA_WRITE},
+    {"OUTPUT",  13, 2, 1, ISA_READ},
+    {"STOP",    14, 1, 0, ISA_STOP},
+    {"SPACE",    0, 1, 1, ISA_SPACE},
+    {"CONST",    0, 1, 1, ISA_CONST},
+    {"SECAO",    0, 0, 1, ISA_SECTION},
+    {"SECTION",  0, 0, 1, ISA_SECTION},
+    {"MACRO",    0, 0, 0, ISA_MACRO},
+    {"ENDMACRO", 0, 0, 0, ISA_ENDMACRO},
+};
+
+constexpr int ISA_SIZE = sizeof(ISA) / sizeof(ISA[0]);
+constexpr int ISA_INVALID = 0;
+
+// Compile-time checks and derived constants (C++11 constexpr: recursion)
+constexpr int isa_count_opcodes(int i) {
+    return i < ISA_SIZE && ISA[i].opcode == i ? isa_count_opcodes(i + 1) : i - 1;
+}
+constexpr int ISA_MAX_OPCODE = isa_count_opcodes(1);
+
+constexpr bool isa_directives_after(int i) {
+    return i == ISA_SIZE || (ISA[i].opcode == 0 && ISA[i].cls >= ISA_SPACE && isa_directives_after(i + 1));
+}
+static_assert(isa_directives_after(ISA_MAX_OPCODE + 1),
+              "ISA: opcodes must be 1, 2, 3... in order, followed only by directives");
+
+constexpr size_t isa_length(const char* s) {
+    return *s ? 1 + isa_length(s + 1) : 0;
+}
+constexpr size_t isa_max_length(int i) {
+    return i == ISA_SIZE ? 0
+         : isa_length(ISA[i].mnemonic) > isa_max_length(i + 1) ? isa_length(ISA[i].mnemonic)
+         : isa_max_length(i + 1);
+}
+constexpr size_t ISA_MAX_MNEMONIC = isa_max_length(1);
+
+// Perfect hash of the mnemonics: the second and last letters and the
+// length pick one of 32 slots, and no two mnemonics share a slot (checked
+// below), so a lookup is one hash and one compare.
+constexpr unsigned ISA_HASH_SLOTS = 32;
+
+constexpr unsigned isa_hash(const char* s, size_t n) {
+    return ((unsigned char)s[1] + 9u * (unsigned char)s[n - 1] + 12u * (unsigned)n) & (ISA_HASH_SLOTS - 1);
+}
+constexpr unsigned isa_entry_hash(int i) {
+    return isa_hash(ISA[i].mnemonic, isa_length(ISA[i].mnemonic));
+}
+// First entry hashing to slot, or ISA_INVALID
+constexpr int isa_find_slot(unsigned slot, int i) {
+    return i == ISA_SIZE ? ISA_INVALID : isa_entry_hash(i) == slot ? i : isa_find_slot(slot, i + 1);
+}
+constexpr bool isa_hash_is_perfect(int i) {
+    return i == ISA_SIZE || (isa_find_slot(isa_entry_hash(i), 1) == i && isa_hash_is_perfect(i + 1));
+}
+static_assert(isa_hash_is_perfect(1), "ISA: two mnemonics share an isa_hash slot, change its multipliers");
+
+// Slot -> entry, built at compile time from the table
+template <unsigned... S> struct IsaSlots {
+    static constexpr signed char index[sizeof...(S)] = {(signed char)isa_find_slot(S, 1)...};
+};
+template <unsigned... S> constexpr signed char IsaSlots<S...>::index[sizeof...(S)];
+
+template <unsigned N, unsigned... S> struct IsaMakeSlots : IsaMakeSlots<N - 1, N - 1, S...> {};
+template <unsigned... S> struct IsaMakeSlots<0, S...> { typedef IsaSlots<S...> type; };
+typedef IsaMakeSlots<ISA_HASH_SLOTS>::type IsaSlotTable;
+
+// Entry for an upper-case word of length n, or ISA_INVALID
+static inline int isa_lookup(const char* word, size_t n) {
+    if (n < 2 || n > ISA_MAX_MNEMONIC) {
+        return ISA_INVALID;
+    }
+    int i = IsaSlotTable::index[isa_hash(word, n)];
+    return strncmp(ISA[i].mnemonic, word, n) == 0 && ISA[i].mnemonic[n] == '\0' ? i : ISA_INVALID;
+}
+
+// Opcode queries for the VM and its tools (op: 0 or a valid opcode)
+constexpr bool isa_opcode(int32_t op) { return op >= 1 && op <= ISA_MAX_OPCODE; }
+constexpr bool isa_jumps(int32_t op) { return ISA[op].cls == ISA_JUMP || ISA[op].cls == ISA_BRANCH; }
+constexpr bool isa_writes(int32_t op) { return ISA[op].cls == ISA_WRITE; }
+constexpr bool isa_stops(int32_t op) { return ISA[op].cls == ISA_STOP; }
+// Execution cannot continue at the next instruction
+constexpr bool isa_ends_flow(int32_t op) { return ISA[op].cls == ISA_JUMP || ISA[op].cls == ISA_STOP; }
+
+#endif // ISA_H
@@ -3,24 +3,13 @@
 #include <cctype>
 #include <sstream>
 
-// Static definitions of instructions with their operand counts
-const std::map<std::string, int> Lexer::INSTRUCTIONS = {
-    {"ADD", 1}, {"SUB", 1}, {"MUL", 1}, {"DIV", 1},
-    {"JMP", 1}, {"JMPN", 1}, {"JMPP", 1}, {"JMPZ", 1},
-    {"COPY", 2}, {"LOAD", 1}, {"STORE", 1},
-    {"INPUT", 1}, {"OUTPUT", 1}, {"STOP", 0}
-};
-
-const std::map<std::string, int> Lexer::DIRECTIVES = {
-    {"SPACE", 1}, {"CONST", 1}, {"MACRO", 0}, {"ENDMACRO", 0},
-    {"SECAO", 1}, {"SECTION", 1}
-};
-
-Lexer::Lexer(const std::vector<std::string>& input_lines) 
-    : lines(input_lines), current_line(0), current_pos(0), 
-      buffered_token(TokenType::END_OF_FILE, "", 0), has_buffered_token(false) {
-    if (!lines.empty()) {
-        current_line_text = lines[0];
+Lexer::Lexer(const SourceBuffer& source, Interner* interner) 
+    : source(source), current_line(0), line_text(""), line_length(0), current_pos(0),
+      interner(interner), buffered_token(TokenType::END_OF_FILE, "", 0, 0),
+      has_buffered_token(false) {
+    if (source.lineCount() > 0) {
+        line_text = source.lineData(0);
+        line_length = source.lineLength(0);
     }
 }
 
@@ -46,11 +35,12 @@ void Lexer::putBackToken(const Token& token) {
 }
 
 Token Lexer::readNextToken() {
-    while (current_line < lines.size()) {
-        if (current_pos >= current_line_text.length()) {
+    while (current_line < source.lineCount()) {
+        if (current_pos >= line_length) {
             current_line++;
-            if (current_line < lines.size()) {
-                current_line_text = lines[current_line];
+            if (current_line < source.lineCount()) {
+                line_text = source.lineData(current_line);
+                line_length = source.lineLength(current_line);
                 current_pos = 0;
             }
             continue;
@@ -59,130 +49,150 @@ Token Lexer::readNextToken() {
         skipWhitespace();
         
         // Skip empty lines
-        if (current_pos >= current_line_text.length()) {
+        if (current_pos >= line_length) {
             continue;
         }
         
+        int line_number = (int)current_line + 1;
+        
         // Handle comments
-        if (current_line_text[current_pos] == ';') {
-            current_pos = current_line_text.length();
+        if (line_text[current_pos] == ';') {
+            current_pos = line_length;
             continue;
         }
         
         // Handle comma
-        if (current_line_text[current_pos] == ',') {
+        if (line_text[current_pos] == ',') {
             current_pos++;
-            return Token(TokenType::COMMA, ",", current_line + 1);
+            return Token(TokenType::COMMA, ",", 1, line_number);
         }
         
         // Read a word
-        std::string word = readWord();
-        if (word.empty()) {
+        const char* word = line_text + current_pos;
+        size_t length = readWord();
+        if (length == 0) {
             continue;
         }
         
         // Check if it's a label (ends with colon)
-        if (current_pos < current_line_text.length() && 
-            current_line_text[current_pos] == ':') {
+        if (current_pos < line_length && line_text[current_pos] == ':') {
             current_pos++;  // Skip the colon
             
-            // Validate label
-            if (!isValidLabel(word)) {
-                return Token(TokenType::ERROR, "Invalid label: " + word, current_line + 1);
+            // Validate label (the parser reports the word as invalid)
+            if (!isValidLabel(word, length)) {
+                return Token(TokenType::ERROR, word, (int)length, line_number);
             }
             
-            return Token(TokenType::LABEL, word, current_line + 1);
+            return Token(TokenType::LABEL, word, (int)length, line_number,
+                         internIdentifier(word, length));
         }
         
-        // Check for section directive
-        std::string upper_word = toUpper(word);
-        if (upper_word == "SECAO" || upper_word == "SECTION") {
-            return Token(TokenType::SECTION, upper_word, current_line + 1);
-        }
-        
-        // Check for macro directives
-        if (upper_word == "MACRO") {
-            return Token(TokenType::MACRO_DEF, upper_word, current_line + 1);
-        }
-        if (upper_word == "ENDMACRO") {
-            return Token(TokenType::MACRO_END, upper_word, current_line + 1);
+        // Keywords: instructions and directives, in any case, looked up in
+        // the ISA table by perfect hash
+        if (length <= ISA_MAX_MNEMONIC) {
+            char upper_word[ISA_MAX_MNEMONIC];
+            for (size_t i = 0; i < length; i++) {
+                upper_word[i] = (char)::toupper((unsigned char)word[i]);
+            }
+            
+            int isa = isa_lookup(upper_word, length);
+            if (isa != ISA_INVALID) {
+                TokenType type = TokenType::INSTRUCTION;
+                switch (ISA[isa].cls) {
+                    case ISA_SECTION: type = TokenType::SECTION; break;
+                    case ISA_MACRO: type = TokenType::MACRO_DEF; break;
+                    case ISA_ENDMACRO: type = TokenType::MACRO_END; break;
+                    case ISA_SPACE:
+                    case ISA_CONST: type = TokenType::DIRECTIVE; break;
+                    default: break;
+                }
+                Token token(type, ISA[isa].mnemonic, (int)isa_length(ISA[isa].mnemonic), line_number);
+                token.isa = isa;
+                return token;
+            }
         }
         
-        // Check if it's an instruction
-        if (isInstruction(upper_word)) {
-            return Token(TokenType::INSTRUCTION, upper_word, current_line + 1);
+        // Otherwise, it's an operand: a number, parsed here, or a symbol to intern
+        char first = word[0];
+        if (std::isdigit((unsigned char)first) || first == '-' || first == '+') {
+            return Token(TokenType::OPERAND, word, (int)length, line_number, -1,
+                         parseNumber(word, length));
         }
-        
-        // Check if it's a directive
-        if (isDirective(upper_word)) {
-            return Token(TokenType::DIRECTIVE, upper_word, current_line + 1);
+        return Token(TokenType::OPERAND, word, (int)length, line_number,
+                     internIdentifier(word, length));
+    }
+    
+    return Token(TokenType::END_OF_FILE, "", 0, (int)current_line + 1);
+}
+
+int Lexer::internIdentifier(const char* word, size_t length) {
+    return interner ? interner->intern(word, length) : -1;
+}
+
+int Lexer::parseNumber(const char* word, size_t length) {
+    std::string number(word, length);
+    
+    // Handle hex numbers
+    if (number.find("0X") != std::string::npos || 
+        number.find("0x") != std::string::npos) {
+        try {
+            return std::stoi(number, nullptr, 16);
+        } catch (...) {
+            return 0;
         }
-        
-        // Otherwise, it's an operand
-        return Token(TokenType::OPERAND, word, current_line + 1);
     }
     
-    return Token(TokenType::END_OF_FILE, "", current_line + 1);
+    // Handle decimal numbers
+    try {
+        return std::stoi(number);
+    } catch (...) {
+        return 0;
+    }
 }
 
 bool Lexer::hasMoreTokens() {
-    return current_line < lines.size();
+    return current_line < source.lineCount();
 }
 
 void Lexer::skipWhitespace() {
-    while (current_pos < current_line_text.length() && 
-           (current_line_text[current_pos] == ' ' || 
-            current_line_text[current_pos] == '\t')) {
+    while (current_pos < line_length && 
+           (line_text[current_pos] == ' ' || 
+            line_text[current_pos] == '\t')) {
         current_pos++;
     }
 }
 
-std::string Lexer::readWord() {
-    std::string word;
+size_t Lexer::readWord() {
+    size_t start = current_pos;
     
-    while (current_pos < current_line_text.length()) {
-        char c = current_line_text[current_pos];
+    while (current_pos < line_length) {
+        char c = line_text[current_pos];
         
         // Stop at whitespace, comma, colon, or comment
         if (c == ' ' || c == '\t' || c == ',' || c == ':' || c == ';') {
             break;
         }
         
-        word += c;
         current_pos++;
     }
     
-    return word;
+    return current_pos - start;
 }
 
-bool Lexer::isValidLabel(const std::string& label) {
-    if (label.empty()) return false;
+bool Lexer::isValidLabel(const char* label, size_t length) {
+    if (length == 0) return false;
     
     // Label must start with letter or underscore
-    if (!std::isalpha(label[0]) && label[0] != '_') {
+    if (!std::isalpha((unsigned char)label[0]) && label[0] != '_') {
         return false;
     }
     
     // Rest can be letters, numbers, or underscore
-    for (size_t i = 1; i < label.length(); i++) {
-        if (!std::isalnum(label[i]) && label[i] != '_') {
+    for (size_t i = 1; i < length; i++) {
+        if (!std::isalnum((unsigned char)label[i]) && label[i] != '_') {
             return false;
         }
     }
     
     return true;
 }
-
-bool Lexer::isInstruction(const std::string& word) {
-    return INSTRUCTIONS.find(word) != INSTRUCTIONS.end();
-}
-
-bool Lexer::isDirective(const std::string& word) {
-    return DIRECTIVES.find(word) != DIRECTIVES.end();
-}
-
-std::string Lexer::toUpper(const std::string& str) {
-    std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(), ::toupper);
-    return result;
-}
@@ -3,7 +3,10 @@
 
 #include <string>
 #include <vector>
-#include <map>
+#include <cstring>
+#include "isa.h"
+#include "source_buffer.h"
+#include "symbol_table.h"
 
 enum class TokenType {
     LABEL,
@@ -19,21 +22,35 @@ enum class TokenType {
     ERROR
 };
 
+// A token is a view into the source buffer, which must outlive it.
+// Keywords point at their upper-case name in the ISA table instead.
 struct Token {
     TokenType type;
-    std::string value;
+    const char* text;
+    int length;
     int line_number;
+    int id;      // Interned identifier for labels and symbolic operands, else -1
+    int number;  // Value of a numeric operand
+    int isa;     // Keywords: entry in the ISA table (isa.h)
     
-    Token(TokenType t, const std::string& v, int line) 
-        : type(t), value(v), line_number(line) {}
+    Token(TokenType t, const char* s, int len, int line, int i = -1, int n = 0) 
+        : type(t), text(s), length(len), line_number(line), id(i), number(n),
+          isa(ISA_INVALID) {}
+    
+    std::string str() const { return std::string(text, length); }
+    bool is(const char* s) const {
+        return strlen(s) == (size_t)length && memcmp(text, s, length) == 0;
+    }
 };
 
 class Lexer {
 private:
-    std::vector<std::string> lines;
-    int current_line;
-    std::string current_line_text;
+    const SourceBuffer& source;
+    size_t current_line;
+    const char* line_text;  // Current line (a view into source)
+    size_t line_length;
     size_t current_pos;
+    Interner* interner;  // Where identifiers are interned (may be null)
     
     // For token buffering
     Token buffered_token;
@@ -41,25 +58,20 @@ private:
     
     // Helper functions
     void skipWhitespace();
-    std::string readWord();
-    bool isValidLabel(const std::string& label);
-    bool isInstruction(const std::string& word);
-    bool isDirective(const std::string& word);
-    std::string toUpper(const std::string& str);
+    size_t readWord();
+    bool isValidLabel(const char* label, size_t length);
     Token readNextToken();
+    int internIdentifier(const char* word, size_t length);
+    static int parseNumber(const char* word, size_t length);
     
 public:
-    Lexer(const std::vector<std::string>& input_lines);
+    Lexer(const SourceBuffer& source, Interner* interner = nullptr);
     Token getNextToken();
     Token peekNextToken();
     void putBackToken(const Token& token);
     bool hasMoreTokens();
-    int getCurrentLine() const { return current_line + 1; }
-    std::string getCurrentLineText() const { return current_line_text; }
-    
-    // Static instruction and directive sets
-    static const std::map<std::string, int> INSTRUCTIONS;
-    static const std::map<std::string, int> DIRECTIVES;
+    int getCurrentLine() const { return (int)current_line + 1; }
+    std::string getCurrentLineText() const { return std::string(line_text, line_length); }
 };
 
 #endif // LEXER_H
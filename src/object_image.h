@@ -0,0 +1,44 @@
+#ifndef OBJECT_IMAGE_H
+#define OBJECT_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary object image (.o2b), shared by the code generator and the simulator.
+//
+// Layout (all fields little-endian):
+//   O2bHeader          fixed 24-byte header
+//   int32_t words[]    word_count memory words, loaded at address 0
+//
+// The checksum covers the words only, so the header can be validated
+// before it is trusted to size the mapping.
+
+#define O2B_MAGIC "SBO2"
+#define O2B_VERSION 1
+
+struct O2bHeader {
+    char magic[4];          // "SBO2"
+    uint16_t version;       // O2B_VERSION
+    uint16_t header_size;   // sizeof(O2bHeader), lets later versions grow it
+    uint32_t word_count;    // number of memory words that follow
+    uint32_t code_end;      // first word after the last instruction (code/data boundary)
+    uint32_t entry;         // initial PC
+    uint32_t checksum;      // o2bChecksum() of the words
+};
+
+static_assert(sizeof(O2bHeader) == 24, "O2bHeader must have no padding");
+
+// FNV-1a over the little-endian bytes of each word
+inline uint32_t o2bChecksum(const int32_t* words, size_t count) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t w = (uint32_t)words[i];
+        for (int b = 0; b < 4; b++) {
+            hash ^= (w >> (8 * b)) & 0xFF;
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+#endif // OBJECT_IMAGE_H
@@ -4,8 +4,9 @@
 #include <algorithm>
 #include <cctype>
 
-Parser::Parser(const std::vector<std::string>& lines) 
-    : lexer(lines), current_address(0), in_text_section(false), in_data_section(false) {
+Parser::Parser(const SourceBuffer& source) 
+    : lexer(source, &symbol_table.getInterner()), current_address(0), in_text_section(false), in_data_section(false),
+      listener(nullptr) {
 }
 
 void Parser::parse() {
@@ -34,7 +35,8 @@ void Parser::parse() {
                 break;
                 
             case TokenType::ERROR:
-                errors.push_back(ParseError(ParseError::LEXICAL, token.value, token.line_number));
+                errors.push_back(ParseError(ParseError::LEXICAL,
+                    "Invalid label: " + token.str(), token.line_number));
                 break;
                 
             case TokenType::COMMA:
@@ -44,67 +46,48 @@ void Parser::parse() {
             case TokenType::OPERAND:
                 // Operand at top level might be an error
                 errors.push_back(ParseError(ParseError::SYNTACTIC, 
-                    "Unexpected operand at top level: " + token.value, token.line_number));
+                    "Unexpected operand at top level: " + token.str(), token.line_number));
                 break;
                 
             default:
                 // Unexpected token
                 errors.push_back(ParseError(ParseError::SYNTACTIC, 
-                    "Unexpected token: " + token.value, token.line_number));
+                    "Unexpected token: " + token.str(), token.line_number));
                 break;
         }
     }
     
-    // Check for undefined symbols
-    std::vector<std::string> undefined = symbol_table.getUndefinedSymbols();
-    for (const auto& sym : undefined) {
-        errors.push_back(ParseError(ParseError::SEMANTIC,
-            "Undefined symbol: " + sym, 0));
-    }
+    // Undefined symbols are not an error here: their slots stay -1 and the
+    // compiler reports them as a warning after code generation
 }
 
 void Parser::parseLabel(Token& token) {
-    std::string label_name = token.value;
-    
     // Check if label already exists
-    if (symbol_table.isSymbolDefined(label_name)) {
+    if (symbol_table.isSymbolDefined(token.id)) {
         errors.push_back(ParseError(ParseError::SEMANTIC,
-            "Duplicate label: " + label_name, token.line_number));
+            "Duplicate label: " + token.str(), token.line_number));
         return;
     }
     
     // Add label to symbol table
-    symbol_table.defineSymbol(label_name, current_address);
+    symbol_table.defineSymbol(token.id, current_address);
+    if (listener) {
+        listener->onLabel(token.id, current_address);
+    }
 }
 
 void Parser::parseInstruction(Token& token) {
     Instruction inst;
-    inst.type = getInstructionType(token.value);
+    inst.isa = token.isa;
     inst.line_number = token.line_number;
-    inst.address = current_address;
     
-    if (inst.type == InstructionType::INVALID) {
+    if (inst.opcode() == 0) {
         errors.push_back(ParseError(ParseError::SEMANTIC,
-            "Invalid instruction: " + token.value, token.line_number));
+            "Invalid instruction: " + token.str(), token.line_number));
         return;
     }
     
-    inst.opcode = getOpcode(inst.type);
-    inst.size = getInstructionSize(inst.type);
-    
-    // Get expected operand count
-    int expected_operands = 0;
-    switch (inst.type) {
-        case InstructionType::COPY:
-            expected_operands = 2;
-            break;
-        case InstructionType::STOP:
-            expected_operands = 0;
-            break;
-        default:
-            expected_operands = 1;
-            break;
-    }
+    int expected_operands = ISA[inst.isa].operands;
     
     // Get operands
     for (int i = 0; i < expected_operands; i++) {
@@ -123,41 +106,40 @@ void Parser::parseInstruction(Token& token) {
         if (lexer.hasMoreTokens()) {
             Token operand = lexer.getNextToken();
             if (operand.type == TokenType::OPERAND) {
-                inst.operands.push_back(operand.value);
+                inst.addOperand(operand);
             } else {
                 errors.push_back(ParseError(ParseError::SYNTACTIC,
-                    "Expected operand for " + token.value, token.line_number));
+                    "Expected operand for " + token.str(), token.line_number));
                 return;
             }
         } else {
             errors.push_back(ParseError(ParseError::SYNTACTIC,
-                "Missing operand for " + token.value, token.line_number));
+                "Missing operand for " + token.str(), token.line_number));
             return;
         }
     }
     
     instructions.push_back(inst);
-    current_address += inst.size;
+    current_address += inst.size();
+    if (listener) {
+        listener->onInstruction(inst);
+    }
 }
 
 void Parser::parseDirective(Token& token) {
     Instruction inst;
+    inst.isa = token.isa;
     inst.line_number = token.line_number;
-    inst.address = current_address;
     
-    if (token.value == "SPACE") {
-        inst.type = InstructionType::SPACE;
-        inst.size = 1;  // Default size
-        
+    if (ISA[inst.isa].cls == ISA_SPACE) {
         // Check for optional operand
         if (lexer.hasMoreTokens()) {
             Token next = lexer.peekNextToken();
             if (next.type == TokenType::OPERAND) {
                 lexer.getNextToken(); // Consume the operand
-                if (isNumber(next.value)) {
-                    int count = parseNumber(next.value);
-                    inst.size = count;
-                    inst.operands.push_back(next.value);
+                std::string count_text = next.str();
+                if (isNumber(count_text)) {
+                    inst.addImmediate(parseNumber(count_text));  // The size
                 } else {
                     errors.push_back(ParseError(ParseError::SYNTACTIC,
                         "SPACE requires numeric operand", token.line_number));
@@ -165,15 +147,13 @@ void Parser::parseDirective(Token& token) {
             }
             // If it's not an operand, leave it for the next iteration
         }
-    } else if (token.value == "CONST") {
-        inst.type = InstructionType::CONST;
-        inst.size = 1;
-        
+    } else if (ISA[inst.isa].cls == ISA_CONST) {
+
         // CONST requires an operand
         if (lexer.hasMoreTokens()) {
             Token next = lexer.getNextToken();
             if (next.type == TokenType::OPERAND) {
-                inst.operands.push_back(next.value);
+                inst.addOperand(next);
             } else {
                 errors.push_back(ParseError(ParseError::SYNTACTIC,
                     "CONST requires an operand", token.line_number));
@@ -187,7 +167,10 @@ void Parser::parseDirective(Token& token) {
     }
     
     instructions.push_back(inst);
-    current_address += inst.size;
+    current_address += inst.size();
+    if (listener) {
+        listener->onInstruction(inst);
+    }
 }
 
 void Parser::parseSection(Token& token) {
@@ -199,7 +182,7 @@ void Parser::parseSection(Token& token) {
         return;
     }
     
-    std::string section_name = next.value;
+    std::string section_name = next.str();
     std::transform(section_name.begin(), section_name.end(), 
                    section_name.begin(), ::toupper);
     
@@ -215,54 +198,6 @@ void Parser::parseSection(Token& token) {
     }
 }
 
-InstructionType Parser::getInstructionType(const std::string& name) {
-    if (name == "ADD") return InstructionType::ADD;
-    if (name == "SUB") return InstructionType::SUB;
-    if (name == "MUL") return InstructionType::MUL;
-    if (name == "DIV") return InstructionType::DIV;
-    if (name == "JMP") return InstructionType::JMP;
-    if (name == "JMPN") return InstructionType::JMPN;
-    if (name == "JMPP") return InstructionType::JMPP;
-    if (name == "JMPZ") return InstructionType::JMPZ;
-    if (name == "COPY") return InstructionType::COPY;
-    if (name == "LOAD") return InstructionType::LOAD;
-    if (name == "STORE") return InstructionType::STORE;
-    if (name == "INPUT") return InstructionType::INPUT;
-    if (name == "OUTPUT") return InstructionType::OUTPUT;
-    if (name == "STOP") return InstructionType::STOP;
-    return InstructionType::INVALID;
-}
-
-int Parser::getOpcode(InstructionType type) {
-    switch (type) {
-        case InstructionType::ADD: return 1;
-        case InstructionType::SUB: return 2;
-        case InstructionType::MUL: return 3;
-        case InstructionType::DIV: return 4;
-        case InstructionType::JMP: return 5;
-        case InstructionType::JMPN: return 6;
-        case InstructionType::JMPP: return 7;
-        case InstructionType::JMPZ: return 8;
-        case InstructionType::COPY: return 9;
-        case InstructionType::LOAD: return 10;
-        case InstructionType::STORE: return 11;
-        case InstructionType::INPUT: return 12;
-        case InstructionType::OUTPUT: return 13;
-        case InstructionType::STOP: return 14;
-        default: return -1;
-    }
-}
-
-int Parser::getInstructionSize(InstructionType type) {
-    switch (type) {
-        case InstructionType::COPY: return 3;
-        case InstructionType::STOP: return 1;
-        case InstructionType::SPACE: return 1;  // Can be overridden
-        case InstructionType::CONST: return 1;
-        default: return 2;
-    }
-}
-
 bool Parser::isNumber(const std::string& str) {
     if (str.empty()) return false;
     
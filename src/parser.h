@@ -4,27 +4,77 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
 #include "lexer.h"
 #include "symbol_table.h"
 
-enum class InstructionType {
-    ADD, SUB, MUL, DIV,
-    JMP, JMPN, JMPP, JMPZ,
-    COPY, LOAD, STORE,
-    INPUT, OUTPUT, STOP,
-    SPACE, CONST,
-    INVALID
+// One instruction or data directive: a fixed 16-byte record. The opcode
+// and size come from the ISA entry (SPACE: from its count), and addresses
+// are the running sum of the sizes, so neither is stored.
+struct Instruction {
+    uint8_t isa;          // Entry in the ISA table (isa.h)
+    uint8_t n_operands;   // Operands present (0-2)
+    uint8_t symbols;      // Bit k set: operand[k] is a symbol ID, else an immediate
+    uint8_t reserved;
+    int32_t line_number;
+    int32_t operand[2];
+    
+    Instruction() : isa(ISA_INVALID), n_operands(0), symbols(0), reserved(0), line_number(0) {
+        operand[0] = operand[1] = 0;
+    }
+    
+    int opcode() const { return ISA[isa].opcode; }
+    int size() const {
+        return ISA[isa].cls == ISA_SPACE && n_operands ? operand[0] : ISA[isa].size;
+    }
+    bool isSymbol(int k) const { return (symbols >> k) & 1; }
+    
+    void addImmediate(int value) { operand[n_operands++] = value; }
+    void addOperand(const Token& token) {
+        if (token.id >= 0) {
+            symbols |= 1 << n_operands;
+            operand[n_operands++] = token.id;
+        } else {
+            addImmediate(token.number);
+        }
+    }
 };
 
-struct Instruction {
-    InstructionType type;
-    int opcode;
-    std::vector<std::string> operands;
-    int size;  // Size in memory words
-    int address;  // Memory address
-    int line_number;
+static_assert(sizeof(Instruction) == 16, "Instruction must stay a 16-byte record");
+
+// Instructions in source order, in fixed-size chunks: appending never moves
+// or copies the records already stored, and walking them allocates nothing
+class InstructionArena {
+private:
+    static const size_t CHUNK = 4096;  // Records per chunk (64 KB)
+    std::vector<std::unique_ptr<Instruction[]>> chunks;
+    size_t count;
+    
+public:
+    InstructionArena() : count(0) {}
+    
+    void push_back(const Instruction& inst) {
+        if (count % CHUNK == 0) {
+            chunks.push_back(std::unique_ptr<Instruction[]>(new Instruction[CHUNK]));
+        }
+        chunks[count / CHUNK][count % CHUNK] = inst;
+        count++;
+    }
+    size_t size() const { return count; }
+    const Instruction& operator[](size_t i) const { return chunks[i / CHUNK][i % CHUNK]; }
     
-    Instruction() : type(InstructionType::INVALID), opcode(-1), size(0), address(0), line_number(0) {}
+    class const_iterator {
+    private:
+        const InstructionArena* arena;
+        size_t i;
+    public:
+        const_iterator(const InstructionArena* a, size_t index) : arena(a), i(index) {}
+        const Instruction& operator*() const { return (*arena)[i]; }
+        const_iterator& operator++() { i++; return *this; }
+        bool operator!=(const const_iterator& other) const { return i != other.i; }
+    };
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
 };
 
 struct ParseError {
@@ -37,21 +87,27 @@ struct ParseError {
         : type(t), message(msg), line_number(line) {}
 };
 
+// Receives labels and instructions in source order, so that code can be
+// emitted in the same pass as parsing (one-pass assembly, see CodeGenerator)
+class ParseListener {
+public:
+    virtual ~ParseListener() {}
+    virtual void onLabel(int symbol, int address) = 0;
+    virtual void onInstruction(const Instruction& inst) = 0;
+};
+
 class Parser {
 private:
+    SymbolTable symbol_table;  // Before lexer: the lexer interns into it
     Lexer lexer;
-    SymbolTable symbol_table;
-    std::vector<Instruction> instructions;
+    InstructionArena instructions;
     std::vector<ParseError> errors;
     int current_address;
     bool in_text_section;
     bool in_data_section;
+    ParseListener* listener;
     
     // Helper functions
-    InstructionType getInstructionType(const std::string& name);
-    int getOpcode(InstructionType type);
-    int getInstructionSize(InstructionType type);
-    bool validateOperandCount(InstructionType type, int count);
     void parseInstruction(Token& token);
     void parseDirective(Token& token);
     void parseLabel(Token& token);
@@ -60,10 +116,11 @@ private:
     int parseNumber(const std::string& str);
     
 public:
-    Parser(const std::vector<std::string>& lines);
+    Parser(const SourceBuffer& source);  // Must outlive the parser
     void parse();
+    void setListener(ParseListener* l) { listener = l; }
     
-    const std::vector<Instruction>& getInstructions() const { return instructions; }
+    const InstructionArena& getInstructions() const { return instructions; }
     const std::vector<ParseError>& getErrors() const { return errors; }
     SymbolTable& getSymbolTable() { return symbol_table; }
     bool hasErrors() const { return !errors.empty(); }
@@ -3,35 +3,66 @@
 #include <sstream>
 #include <fstream>
 #include <cctype>
+#include <cstring>
+#include <stdexcept>
 
-Preprocessor::Preprocessor(const std::vector<std::string>& lines) 
-    : input_lines(lines) {
+Preprocessor::Preprocessor(SourceBuffer source) 
+    : input(std::move(source)) {
 }
 
-std::vector<std::string> Preprocessor::preprocess() {
-    output_lines.clear();
+// Case-insensitive search for an upper-case word
+static bool containsUpper(const char* data, size_t length, const char* word) {
+    size_t n = strlen(word);
+    for (size_t i = 0; i + n <= length; i++) {
+        size_t j = 0;
+        while (j < n && std::toupper((unsigned char)data[i + j]) == word[j]) {
+            j++;
+        }
+        if (j == n) return true;
+    }
+    return false;
+}
+
+static bool equalsUpper(const char* data, size_t length, const char* word) {
+    return length == strlen(word) && containsUpper(data, length, word);
+}
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+const SourceBuffer& Preprocessor::preprocess() {
+    output = SourceBuffer();
+    output.reserve(input.contents().size(), input.lineCount());
+    
+    // Lines are views into the input buffer; only macro definitions and
+    // calls are copied into strings
+    const char* line;
+    size_t length;
     
     // First pass: collect macro definitions
     bool in_macro = false;
     Macro current_macro;
     
-    for (size_t i = 0; i < input_lines.size(); i++) {
-        std::string line = removeComments(input_lines[i]);
-        line = trim(line);
+    for (size_t i = 0; i < input.lineCount(); i++) {
+        line = input.lineData(i);
+        length = input.lineLength(i);
+        stripLine(line, length);
         
-        if (line.empty()) continue;
+        if (length == 0) continue;
         
         // Check for macro definition
-        if (isMacroDefinition(line)) {
+        if (isMacroDefinition(line, length)) {
             in_macro = true;
+            std::string definition(line, length);
             // Parse macro name and parameters
-            size_t pos = line.find("MACRO");
+            size_t pos = definition.find("MACRO");
             if (pos == std::string::npos) {
-                pos = line.find("macro");
+                pos = definition.find("macro");
             }
             
             // Get the label before MACRO
-            std::string before_macro = line.substr(0, pos);
+            std::string before_macro = definition.substr(0, pos);
             before_macro = trim(before_macro);
             
             // Remove colon if present
@@ -42,7 +73,7 @@ std::vector<std::string> Preprocessor::preprocess() {
             current_macro = Macro(trim(before_macro));
             
             // Check for parameters after MACRO
-            std::string after_macro = line.substr(pos + 5); // Skip "MACRO"
+            std::string after_macro = definition.substr(pos + 5); // Skip "MACRO"
             after_macro = trim(after_macro);
             
             if (!after_macro.empty()) {
@@ -53,7 +84,7 @@ std::vector<std::string> Preprocessor::preprocess() {
         }
         
         // Check for end of macro
-        if (in_macro && toUpper(line) == "ENDMACRO") {
+        if (in_macro && equalsUpper(line, length, "ENDMACRO")) {
             macros[current_macro.name] = current_macro;
             in_macro = false;
             current_macro = Macro();
@@ -62,55 +93,48 @@ std::vector<std::string> Preprocessor::preprocess() {
         
         // If inside macro, add to body
         if (in_macro) {
-            current_macro.body.push_back(line);
+            current_macro.body.push_back(std::string(line, length));
             continue;
         }
     }
     
     // Second pass: expand macros and process directives
-    for (size_t i = 0; i < input_lines.size(); i++) {
-        std::string line = removeComments(input_lines[i]);
-        line = trim(line);
+    for (size_t i = 0; i < input.lineCount(); i++) {
+        line = input.lineData(i);
+        length = input.lineLength(i);
+        stripLine(line, length);
         
-        if (line.empty()) continue;
+        if (length == 0) continue;
         
         // Skip macro definitions in second pass
-        if (isMacroDefinition(line)) {
+        if (isMacroDefinition(line, length)) {
             // Skip until ENDMACRO
-            while (i < input_lines.size() && toUpper(trim(input_lines[i])) != "ENDMACRO") {
+            while (i < input.lineCount()) {
+                line = input.lineData(i);
+                length = input.lineLength(i);
+                trim(line, length);
+                if (equalsUpper(line, length, "ENDMACRO")) {
+                    break;
+                }
                 i++;
             }
             continue;
         }
         
         // Check for macro call
-        bool expanded = false;
-        if (isMacroCall(line)) {
-            // Parse macro call
-            std::istringstream iss(line);
-            std::string macro_name;
-            iss >> macro_name;
-            
-            // Remove colon if it's a label
-            if (!macro_name.empty() && macro_name.back() == ':') {
-                macro_name.pop_back();
-            }
-            
-            if (macros.find(macro_name) != macros.end()) {
-                std::vector<std::string> expanded_lines = expandMacro(line, macros[macro_name]);
-                for (const auto& exp_line : expanded_lines) {
-                    output_lines.push_back(exp_line);
-                }
-                expanded = true;
+        const Macro* macro = findMacroCall(line, length);
+        if (macro) {
+            for (const auto& exp_line : expandMacro(std::string(line, length), *macro)) {
+                output.appendLine(exp_line);
             }
-        }
-        
-        if (!expanded) {
-            output_lines.push_back(line);
+        } else {
+            output.appendLine(line, length);
         }
     }
     
-    return output_lines;
+    // The stages after this one only need the output
+    input = SourceBuffer();
+    return output;
 }
 
 void Preprocessor::writeToFile(const std::string& filename) {
@@ -119,19 +143,27 @@ void Preprocessor::writeToFile(const std::string& filename) {
         throw std::runtime_error("Cannot open file for writing: " + filename);
     }
     
-    for (const auto& line : output_lines) {
-        out << line << "\n";
-    }
+    out.write(output.contents().data(), output.contents().size());
     
     out.close();
 }
 
-std::string Preprocessor::removeComments(const std::string& line) {
-    size_t comment_pos = line.find(';');
-    if (comment_pos != std::string::npos) {
-        return line.substr(0, comment_pos);
+void Preprocessor::stripLine(const char*& data, size_t& length) {
+    const char* comment = (const char*)memchr(data, ';', length);
+    if (comment) {
+        length = comment - data;
+    }
+    trim(data, length);
+}
+
+void Preprocessor::trim(const char*& data, size_t& length) {
+    while (length > 0 && isBlank(data[0])) {
+        data++;
+        length--;
+    }
+    while (length > 0 && isBlank(data[length - 1])) {
+        length--;
     }
-    return line;
 }
 
 std::string Preprocessor::trim(const std::string& str) {
@@ -142,30 +174,27 @@ std::string Preprocessor::trim(const std::string& str) {
     return str.substr(first, last - first + 1);
 }
 
-std::string Preprocessor::toUpper(const std::string& str) {
-    std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(), ::toupper);
-    return result;
-}
-
-bool Preprocessor::isMacroDefinition(const std::string& line) {
-    std::string upper_line = toUpper(line);
-    return upper_line.find("MACRO") != std::string::npos && 
-           upper_line.find("ENDMACRO") == std::string::npos;
+bool Preprocessor::isMacroDefinition(const char* line, size_t length) {
+    return containsUpper(line, length, "MACRO") && 
+           !containsUpper(line, length, "ENDMACRO");
 }
 
-bool Preprocessor::isMacroCall(const std::string& line) {
+const Macro* Preprocessor::findMacroCall(const char* line, size_t length) {
     // A macro call is a line that starts with a macro name
-    std::istringstream iss(line);
-    std::string first_word;
-    iss >> first_word;
+    if (macros.empty()) return nullptr;
+    
+    size_t start = 0;
+    while (start < length && std::isspace((unsigned char)line[start])) start++;
+    size_t end = start;
+    while (end < length && !std::isspace((unsigned char)line[end])) end++;
     
     // Remove colon if present
-    if (!first_word.empty() && first_word.back() == ':') {
-        first_word.pop_back();
+    if (end > start && line[end - 1] == ':') {
+        end--;
     }
     
-    return macros.find(first_word) != macros.end();
+    auto it = macros.find(std::string(line + start, end - start));
+    return it != macros.end() ? &it->second : nullptr;
 }
 
 std::vector<std::string> Preprocessor::expandMacro(const std::string& line, const Macro& macro) {
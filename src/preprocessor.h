@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include "source_buffer.h"
 
 struct Macro {
     std::string name;
@@ -16,17 +17,17 @@ struct Macro {
 
 class Preprocessor {
 private:
-    std::vector<std::string> input_lines;
-    std::vector<std::string> output_lines;
+    SourceBuffer input;   // Released once preprocessed
+    SourceBuffer output;
     std::map<std::string, Macro> macros;
     std::map<std::string, int> constants;  // For EQU directives (if needed)
     
     // Helper functions
-    std::string removeComments(const std::string& line);
+    static void stripLine(const char*& data, size_t& length);  // Comment and blanks
+    static void trim(const char*& data, size_t& length);
     std::string trim(const std::string& str);
-    std::string toUpper(const std::string& str);
-    bool isMacroDefinition(const std::string& line);
-    bool isMacroCall(const std::string& line);
+    bool isMacroDefinition(const char* line, size_t length);
+    const Macro* findMacroCall(const char* line, size_t length);
     std::vector<std::string> expandMacro(const std::string& line, const Macro& macro);
     std::vector<std::string> splitParameters(const std::string& params);
     std::string replaceParameters(const std::string& line, 
@@ -34,8 +35,8 @@ private:
                                    const std::vector<std::string>& args);
     
 public:
-    Preprocessor(const std::vector<std::string>& lines);
-    std::vector<std::string> preprocess();
+    Preprocessor(SourceBuffer source);
+    const SourceBuffer& preprocess();
     void writeToFile(const std::string& filename);
 };
 
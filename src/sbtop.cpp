@@ -0,0 +1,176 @@
+/*
+ * sbtop: mostra ao vivo os contadores de uma execução publicados por
+ * "simulador --stats-shm=nome" (formato em stats_shm.h).
+ *
+ * Uso:
+ *   ./sbtop nome [--interval=ms] [--once]
+ *
+ * A tela é redesenhada a cada intervalo (padrão 1000 ms) até a execução
+ * terminar; --once imprime um único quadro, sem limpar a tela. O
+ * histograma de opcodes diz de onde vem (SbsStats::op_source): contado,
+ * com as execuções de cada opcode, ou amostrado (uma amostra por
+ * atualização do simulador), em que a coluna "passos (est.)" é a fração
+ * das amostras vezes os passos.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "isa.h"
+#include "stats_shm.h"
+
+#define STALE_NS 2000000000ull // sem atualização há mais que isso: provavelmente esperando INPUT
+
+static void usage(const char *a)
+{
+  fprintf(stderr, "Uso: %s nome [--interval=ms] [--once]\n", a);
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* v com sufixo k/M/G/T em buf. */
+static const char *human(char *buf, size_t size, double v)
+{
+  static const char *const SUFFIX[] = {"", " k", " M", " G", " T"};
+  int i = 0;
+  while (v >= 1000 && i < 4)
+  {
+    v /= 1000;
+    ++i;
+  }
+  snprintf(buf, size, i ? "%.1f%s" : "%.0f%s", v, SUFFIX[i]);
+  return buf;
+}
+
+static void show(const char *name, const SbsStats *s, uint64_t now)
+{
+  char a[32], b[32];
+  uint64_t secs = (s->update_ns - s->start_ns) / 1000000000ull;
+  printf("sbtop %s   pid %u   %s\n", name, s->pid, s->program);
+  if (s->state == SBS_DONE)
+    printf("terminou: %s (status %d) em %02llu:%02llu:%02llu\n", s->exit_status ? "erro" : "STOP",
+           s->exit_status, (unsigned long long)(secs / 3600), (unsigned long long)(secs / 60 % 60),
+           (unsigned long long)(secs % 60));
+  else
+  {
+    printf("rodando há %02llu:%02llu:%02llu", (unsigned long long)(secs / 3600),
+           (unsigned long long)(secs / 60 % 60), (unsigned long long)(secs % 60));
+    if (now - s->update_ns > STALE_NS)
+      printf("   (sem atualizações há %llu s: INPUT esperando entrada?)",
+             (unsigned long long)((now - s->update_ns) / 1000000000ull));
+    printf("\n");
+  }
+  printf("\npassos     %20llu   (%s passos/s)\n", (unsigned long long)s->steps,
+         human(a, sizeof a, (double)s->steps_per_sec));
+  printf("PC         %20u   ACC %d\n", s->pc, s->acc);
+  printf("INPUT      %20llu   OUTPUT %llu\n\n", (unsigned long long)s->inputs,
+         (unsigned long long)s->outputs);
+  if (s->op_source == SBS_OPS_COUNTED)
+  {
+    uint64_t total = 0;
+    for (int op = 0; op <= ISA_MAX_OPCODE; ++op)
+      total += s->ops[op];
+    printf("opcodes, contagem exata\n");
+    printf("%-8s %22s %8s\n", "opcode", "execuções", "%"); // 2 bytes a mais: "çõ"
+    for (int op = 0; op <= ISA_MAX_OPCODE; ++op)
+      if (s->ops[op])
+        printf("%-8s %20llu %7.1f%%\n", ISA[op].mnemonic, (unsigned long long)s->ops[op],
+               100 * (double)s->ops[op] / (double)total);
+    if (!total)
+      printf("(nenhuma contagem ainda)\n");
+  }
+  else
+  {
+    printf("opcodes, estimativa por amostragem (%llu amostras)\n", (unsigned long long)s->samples);
+    printf("%-8s %12s %8s %14s\n", "opcode", "amostras", "%", "passos (est.)");
+    for (int op = 0; op <= ISA_MAX_OPCODE; ++op)
+    {
+      if (!s->ops[op])
+        continue;
+      double share = (double)s->ops[op] / (double)s->samples;
+      printf("%-8s %12llu %7.1f%% %14s\n", ISA[op].mnemonic, (unsigned long long)s->ops[op], 100 * share,
+             human(b, sizeof b, share * (double)s->steps));
+    }
+    if (!s->samples)
+      printf("(nenhuma amostra ainda)\n");
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  long interval = 1000;
+  int once = 0;
+  for (int i = 2; i < argc; ++i)
+  {
+    int used = 0;
+    if (sscanf(argv[i], "--interval=%ld%n", &interval, &used) == 1 && !argv[i][used] && interval > 0)
+      continue;
+    if (!strcmp(argv[i], "--once"))
+    {
+      once = 1;
+      continue;
+    }
+    usage(argv[0]);
+    return 1;
+  }
+
+  char name[256];
+  snprintf(name, sizeof name, "%s%s", argv[1][0] == '/' ? "" : "/", argv[1]);
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+  {
+    fprintf(stderr, "Não foi possível abrir o segmento '%s' (o simulador está rodando com --stats-shm?)\n", name);
+    return 1;
+  }
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SbsStats))
+    map = mmap(NULL, sizeof(SbsStats), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  const SbsStats *shm = (const SbsStats *)map;
+  SbsStats s;
+  if (map == MAP_FAILED || !SbsStats_read(shm, &s) || memcmp(s.magic, SBS_MAGIC, 4) != 0 ||
+      s.version != SBS_VERSION || s.size != sizeof(SbsStats))
+  {
+    fprintf(stderr, "Erro: '%s' não é um segmento de contadores do simulador\n", name);
+    return 1;
+  }
+
+  while (1)
+  {
+    if (!once)
+      printf("\033[H\033[2J");
+    show(name, &s, now_ns());
+    if (once || s.state == SBS_DONE)
+      return 0;
+    if (kill((pid_t)s.pid, 0) < 0 && errno == ESRCH)
+    {
+      printf("o simulador terminou sem publicar o fim da execução\n");
+      return 1;
+    }
+    usleep((useconds_t)interval * 1000);
+    if (!SbsStats_read(shm, &s))
+    {
+      fprintf(stderr, "Erro: o segmento não se estabilizou para leitura\n");
+      return 1;
+    }
+  }
+}
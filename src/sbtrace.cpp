@@ -0,0 +1,90 @@
+/*
+ * sbtrace: imprime como texto um trace binário gerado por
+ * "simulador --trace-file=arq.sbt" (formato em trace_format.h).
+ *
+ * Uso:
+ *   ./sbtrace arq.sbt [--from=passo] [--count=N] [--pc=ini:fim]
+ *
+ * Cada linha traz o passo, o PC, o ACC antes da instrução, o mnemônico, o
+ * endereço efetivo e o valor lido (mem[a]=v) ou escrito (mem[a]<-v).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "isa.h"
+#include "trace_format.h"
+
+static void usage(const char *a)
+{
+  fprintf(stderr, "Uso: %s arq.sbt [--from=passo] [--count=N] [--pc=ini:fim]\n", a);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  unsigned long long from = 0, count = ~0ull;
+  unsigned lo = 0, hi = 0xFFFF;
+  for (int i = 2; i < argc; ++i)
+  {
+    int used = 0;
+    if (sscanf(argv[i], "--from=%llu%n", &from, &used) == 1 && !argv[i][used])
+      continue;
+    if (sscanf(argv[i], "--count=%llu%n", &count, &used) == 1 && !argv[i][used])
+      continue;
+    if (sscanf(argv[i], "--pc=%u:%u%n", &lo, &hi, &used) == 2 && !argv[i][used] && lo <= hi)
+      continue;
+    usage(argv[0]);
+    return 1;
+  }
+
+  FILE *f = fopen(argv[1], "rb");
+  if (!f)
+  {
+    fprintf(stderr, "Não foi possível abrir '%s'\n", argv[1]);
+    return 1;
+  }
+  SbtHeader h;
+  if (fread(&h, sizeof h, 1, f) != 1 || memcmp(h.magic, SBT_MAGIC, 4) != 0 ||
+      h.version != SBT_VERSION || h.record_size != sizeof(SbtRecord))
+  {
+    fprintf(stderr, "Erro: '%s' não é um trace .sbt válido\n", argv[1]);
+    fclose(f);
+    return 1;
+  }
+  printf("# %llu registros no arquivo, %llu produzidos", (unsigned long long)h.written,
+         (unsigned long long)h.total);
+  if (h.every > 1)
+    printf(", um a cada %u passos", h.every);
+  if (h.flags & SBT_RING)
+    printf(" (só os últimos)");
+  printf("\n");
+
+  SbtRecord buf[4096];
+  size_t n;
+  while (count && (n = fread(buf, sizeof buf[0], sizeof buf / sizeof buf[0], f)) > 0)
+  {
+    for (size_t i = 0; i < n && count; ++i)
+    {
+      const SbtRecord *r = &buf[i];
+      if (r->step < from || r->pc < lo || r->pc > hi)
+        continue;
+      --count;
+      printf("%10llu  PC=%-5u ACC=%-11d %-6s", (unsigned long long)r->step, r->pc, r->acc,
+             ISA[isa_opcode(r->op) ? r->op : 0].mnemonic);
+      if (r->flags & SBT_WRITE)
+        printf(" mem[%u]<-%d", r->addr, r->value);
+      else if (r->flags & SBT_READ)
+        printf(" mem[%u]=%d", r->addr, r->value);
+      else if (r->flags & SBT_JUMP)
+        printf(" -> %u", r->addr);
+      printf("\n");
+    }
+  }
+  fclose(f);
+  return 0;
+}
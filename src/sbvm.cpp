@@ -0,0 +1,2328 @@
+/*
+ * libsbvm: núcleo da máquina hipotética (Software Básico - UnB), usado pelo
+ * simulador e embutível em outros programas (API em sbvm.h).
+ * Formato .o2: inteiros separados por espaço ou quebra de linha.
+ * Formato .o2b: imagem binária com cabeçalho (object_image.h), carregada por mmap.
+ *
+ * OPCODES:
+ * 01 ADD op     ACC = ACC + mem[op]
+ * 02 SUB op     ACC = ACC - mem[op]
+ * 03 MUL op     ACC = ACC * mem[op]
+ * 04 DIV op     ACC = ACC / mem[op]         (erro se mem[op] == 0 ou se o quociente
+ *                                           não cabe: ACC = INT32_MIN e mem[op] == -1)
+ * 05 JMP op     PC = op
+ * 06 JMPN op    if (ACC < 0) PC = op
+ * 07 JMPP op    if (ACC > 0) PC = op
+ * 08 JMPZ op    if (ACC == 0) PC = op
+ * 09 COPY a b   mem[b] = mem[a]
+ * 10 LOAD op    ACC = mem[op]
+ * 11 STORE op   mem[op] = ACC
+ * 12 INPUT op   lê int do stdin -> mem[op]
+ * 13 OUTPUT op  imprime mem[op]\n
+ * 14 STOP       halt
+ *
+ * Tamanhos: quase tudo 2 palavras; COPY = 3; STOP = 1.
+ *
+ * Motores de execução:
+ *   threaded  (padrão) decodifica cada instrução uma única vez em um registro
+ *             {handler, operandos} e despacha com computed goto.
+ *   switch    laço de referência: relê mem[PC] e faz o switch a cada passo.
+ *             O trace textual e o binário sempre usam este motor.
+ *   jit       (x86-64) traduz blocos básicos para código nativo.
+ *
+ * Na carga, um verificador estático tenta provar que o programa mantém PC e
+ * operandos dentro da memória e nunca escreve no próprio código. Com a prova,
+ * os motores usam o caminho sem checagens.
+ *
+ * Todo o estado de uma execução (memória, registradores, E/S, registros
+ * decodificados e blocos traduzidos) fica em um Vm; a imagem carregada e a
+ * prova são compartilhadas, só para leitura, entre as VMs.
+ *
+ * Nada aqui encerra o processo: erros de carga voltam como mensagem e erros
+ * em execução ficam em vm->err. Isso inclui as operações que travariam a
+ * CPU hospedeira: DIV por zero e INT32_MIN / -1 são checados em todos os
+ * motores (também no C gerado e nos lanes) antes de dividir.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sbvm.h"
+#include "object_image.h"
+#include "trace_format.h"
+
+void io_flush(Io *io)
+{
+  if (io->out_fd < 0)
+  {
+    if (io->cap_len + io->out_len > io->cap_size)
+    {
+      size_t size = io->cap_size ? io->cap_size : IO_OUT_SIZE;
+      while (size < io->cap_len + io->out_len)
+        size *= 2;
+      char *p = (char *)realloc(io->cap, size);
+      if (!p)
+      {
+        io->out_len = 0;
+        return;
+      }
+      io->cap = p;
+      io->cap_size = size;
+    }
+    memcpy(io->cap + io->cap_len, io->out, io->out_len);
+    io->cap_len += io->out_len;
+    io->out_len = 0;
+    return;
+  }
+  size_t off = 0;
+  while (off < io->out_len)
+  {
+    ssize_t w = write(io->out_fd, io->out + off, io->out_len - off);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      // descritor O_NONBLOCK cheio: o resto espera o próximo io_flush
+      memmove(io->out, io->out + off, io->out_len - off);
+      io->out_len -= off;
+      return;
+    }
+    if (w <= 0)
+      break;
+    off += (size_t)w;
+  }
+  io->out_len = 0;
+}
+
+void io_reset(Io *io, int out_fd, int in_fd, int interactive)
+{
+  if (io->in_map)
+    munmap(io->in_map, io->in_map_len);
+  io->in_map = NULL;
+  io->in_map_len = 0;
+  io->out_len = 0;
+  io->out_fd = out_fd;
+  io->interactive = interactive;
+  io->cap_len = 0;
+  io->in = io->in_end = io->in_start = NULL;
+  io->in_base = 0;
+  io->in_fd = in_fd;
+  io->n_in = io->n_out = 0;
+}
+
+int io_open_input(Io *io, const char *path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+  {
+    close(fd);
+    return 0;
+  }
+  io->in_fd = -1;
+  io->in = io->in_end = NULL;
+  if (st.st_size > 0)
+  {
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+      close(fd);
+      return 0;
+    }
+    io->in_map = map;
+    io->in_map_len = (size_t)st.st_size;
+    io->in = io->in_start = (const char *)map;
+    io->in_end = io->in + st.st_size;
+  }
+  close(fd);
+  return 1;
+}
+
+/*
+ * Recarrega o buffer de entrada. Os bytes a partir de *keep (o número
+ * sendo lido) vão para o início do buffer, para que a leitura possa
+ * recomeçar dele se o descritor ainda não tem o resto.
+ */
+static int io_fill(Io *io, const char **keep)
+{
+  if (io->in_fd < 0)
+    return -1;
+  io_flush(io);
+  const char *from = io->in_end; // in == in_end: nada mais a guardar
+  if (keep && (size_t)(io->in_end - *keep) < sizeof io->in_buf)
+    from = *keep;
+  size_t kept = (size_t)(io->in_end - from);
+  io->in_base += (uint64_t)(from - io->in_start);
+  if (kept)
+    memmove(io->in_buf, from, kept);
+  io->in_start = io->in_buf;
+  io->in = io->in_end = io->in_buf + kept;
+  if (keep)
+    *keep = io->in_buf; // número maior que o buffer: recomeça do que vier agora
+  ssize_t r;
+  do
+    r = read(io->in_fd, io->in_buf + kept, sizeof io->in_buf - kept);
+  while (r < 0 && errno == EINTR);
+  if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return -2;
+  if (r <= 0)
+  {
+    io->in_fd = -1;
+    return -1;
+  }
+  io->in_end += r;
+  return (unsigned char)*io->in;
+}
+
+/* Próximo byte da entrada; -1 no fim, -2 se o descritor O_NONBLOCK ainda não tem dados. */
+static inline int io_peek(Io *io, const char **keep)
+{
+  if (io->in == io->in_end)
+    return io_fill(io, keep);
+  return (unsigned char)*io->in;
+}
+
+uint64_t io_offset(const Io *io)
+{
+  return io->in_base + (uint64_t)(io->in - io->in_start);
+}
+
+int io_skip(Io *io, uint64_t n)
+{
+  while (n)
+  {
+    if (io_peek(io, NULL) < 0)
+      return 0;
+    size_t k = (size_t)(io->in_end - io->in);
+    if (k > n)
+      k = (size_t)n;
+    io->in += k;
+    n -= k;
+  }
+  return 1;
+}
+
+/*
+ * Mesmo contrato de scanf("%lld"): pula espaços, sinal opcional, dígitos.
+ * Num descritor O_NONBLOCK o número só conta depois do primeiro byte que
+ * não é dígito (ou do fim da entrada); antes disso devolve -1 e a próxima
+ * chamada recomeça do sinal.
+ */
+int io_next_int(Io *io, long long *out)
+{
+  int c;
+  while ((c = io_peek(io, NULL)) == ' ' || (c >= '\t' && c <= '\r'))
+    ++io->in;
+  if (c == -2)
+    return -1;
+  const char *start = io->in;
+  int neg = 0;
+  if (c == '-' || c == '+')
+  {
+    neg = c == '-';
+    ++io->in;
+    c = io_peek(io, &start);
+  }
+  unsigned long long v = 0;
+  int overflow = 0;
+  if (c >= '0' && c <= '9')
+    while ((c = io_peek(io, &start)) >= '0' && c <= '9')
+    {
+      if (v > (ULLONG_MAX - 9) / 10)
+        overflow = 1;
+      else
+        v = v * 10 + (unsigned)(c - '0');
+      ++io->in;
+    }
+  else if (c != -2)
+    return 0;
+  if (c == -2)
+  {
+    io->in = start;
+    return -1;
+  }
+  // fora da faixa satura como strtoll
+  if (neg)
+    *out = (overflow || v > (unsigned long long)LLONG_MAX + 1) ? LLONG_MIN : (long long)(0 - v);
+  else
+    *out = (overflow || v > (unsigned long long)LLONG_MAX) ? LLONG_MAX : (long long)v;
+  return 1;
+}
+
+int io_put_int(Io *io, int32_t v)
+{
+  if (io->out_len > IO_OUT_SIZE - 16)
+  {
+    io_flush(io);
+    if (io->out_len > IO_OUT_SIZE - 16)
+      return -1; // descritor O_NONBLOCK cheio
+  }
+  char tmp[12];
+  int n = 0;
+  uint32_t u = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+  do
+    tmp[n++] = (char)('0' + u % 10);
+  while (u /= 10);
+  char *p = io->out + io->out_len;
+  if (v < 0)
+    *p++ = '-';
+  while (n)
+    *p++ = tmp[--n];
+  *p++ = '\n';
+  io->out_len = (size_t)(p - io->out);
+  if (io->interactive)
+    io_flush(io);
+  return 1;
+}
+
+/* INPUT e OUTPUT dos motores; step é o número do passo do INPUT. */
+static inline int io_read_int(Io *io, long long step, long long *out)
+{
+  int got = io->in_fn ? io->in_fn(io->fn_ctx, step, out) : io_next_int(io, out);
+  io->n_in += got > 0;
+  return got;
+}
+
+static inline int io_write_int(Io *io, int32_t v)
+{
+  if (io->out_fn)
+    io->out_fn(io->fn_ctx, v);
+  else if (io_put_int(io, v) < 0)
+    return -1; // o OUTPUT roda de novo ao retomar
+  ++io->n_out;
+  return 1;
+}
+
+/* 1 se leu, 0 se não abre, -1 se não cabe na memória. */
+static int read_all_ints(const char *path, int32_t *mem, size_t *out_len)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return 0;
+  size_t i = 0;
+  while (1)
+  {
+    long long v;
+    int r = fscanf(f, "%lld", &v);
+    if (r == EOF)
+      break;
+    if (r != 1)
+    {
+      int c = fgetc(f);
+      if (c == EOF)
+        break;
+      continue;
+    } // ignora “lixo”
+    if (i >= MEM_SIZE)
+    {
+      fclose(f);
+      return -1;
+    }
+    mem[i++] = (int32_t)v;
+  }
+  fclose(f);
+  *out_len = i;
+  return 1;
+}
+
+/*
+ * Imagem binária .o2b (ver object_image.h): mapeia o arquivo e copia as
+ * palavras direto para mem, sem parsing. Devolve 1 se carregou, 0 se o
+ * arquivo não é .o2b e -1 se não abre; com cabeçalho inválido devolve -2
+ * e o motivo em *why.
+ */
+static int load_o2b(const char *path, int32_t *mem, Image *img, const char **why)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(O2bHeader))
+  {
+    close(fd);
+    return 0;
+  }
+  size_t len = (size_t)st.st_size;
+  void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return 0;
+  O2bHeader h;
+  memcpy(&h, map, sizeof h);
+  if (memcmp(h.magic, O2B_MAGIC, 4) != 0)
+  {
+    munmap(map, len);
+    return 0;
+  }
+  if (h.version != O2B_VERSION || h.header_size < sizeof(O2bHeader) ||
+      len < (size_t)h.header_size + 4 * (size_t)h.word_count)
+    *why = "imagem .o2b corrompida ou de versão desconhecida";
+  else if (h.word_count > MEM_SIZE)
+    *why = "programa maior que MEM_SIZE";
+  else if (h.entry >= MEM_SIZE || h.code_end > h.word_count)
+    *why = "imagem .o2b com entrada ou fronteira inválida";
+  if (*why)
+  {
+    munmap(map, len);
+    return -2;
+  }
+  memcpy(mem, (const char *)map + h.header_size, 4 * (size_t)h.word_count);
+  munmap(map, len);
+  if (o2bChecksum(mem, h.word_count) != h.checksum)
+  {
+    *why = "imagem .o2b com checksum inválido";
+    return -2;
+  }
+  img->n = h.word_count;
+  img->entry = h.entry;
+  img->code_end = h.code_end;
+  return 1;
+}
+
+static void proof_fail(Proof *p, uint32_t pc, const char *fmt, ...)
+{
+  if (p->n_reasons < MAX_REASONS)
+  {
+    char m[64];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(m, sizeof m, fmt, ap);
+    va_end(ap);
+    snprintf(p->reasons[p->n_reasons], sizeof p->reasons[0], "PC=%u: %s", pc, m);
+  }
+  ++p->n_reasons;
+  p->ok = 0;
+}
+
+/*
+ * Verificador estático, executado na carga. Percorre o grafo de controle a
+ * partir do ponto de entrada usando os tamanhos fixos (2; COPY 3; STOP 1) e os alvos de
+ * salto, e tenta provar que toda instrução alcançável tem opcode válido,
+ * operandos dentro da memória, não deixa o PC sair da memória e não escreve
+ * (STORE/COPY/INPUT) em nenhuma palavra de código. Com a prova, o código é
+ * imutável e os motores dispensam as checagens por passo.
+ *
+ * Preenche img->proof, img->leader, img->run_len e img->write_page a partir
+ * de img->words.
+ */
+static void verify_image(Image *img)
+{
+  // alocados por chamada: imagens podem ser carregadas em threads diferentes
+  uint32_t *work = (uint32_t *)malloc(MEM_SIZE * sizeof(uint32_t));
+  uint8_t *is_instr = (uint8_t *)calloc(MEM_SIZE, 1); // início de instrução alcançável
+  uint8_t *is_code = (uint8_t *)calloc(MEM_SIZE, 1);  // palavra de instrução alcançável
+  const int32_t *mem = img->words;
+  uint8_t *leader = img->leader;
+  Proof *p = &img->proof;
+  memset(img->leader, 0, sizeof img->leader);
+  memset(img->run_len, 0, sizeof img->run_len);
+  memset(img->write_page, 1, sizeof img->write_page);
+  memset(p, 0, sizeof *p);
+  p->ok = 1;
+  if (!work || !is_instr || !is_code)
+  {
+    proof_fail(p, img->entry, "memória insuficiente para verificar");
+    free(work);
+    free(is_instr);
+    free(is_code);
+    return;
+  }
+
+  size_t top = 0;
+  work[top++] = img->entry;
+  leader[img->entry] = 1;
+  while (top)
+  {
+    uint32_t pc = work[--top];
+    while (!is_instr[pc])
+    {
+      int32_t op = mem[pc];
+      if (!isa_opcode(op))
+      {
+        proof_fail(p, pc, "opcode desconhecido %d", op);
+        break;
+      }
+      uint32_t next = pc + op_size(op);
+      if (next > MEM_SIZE)
+      {
+        proof_fail(p, pc, "%s ultrapassa o fim da memória", ISA[op].mnemonic);
+        break;
+      }
+      is_instr[pc] = 1;
+      ++p->n_instr;
+      for (uint32_t k = pc; k < next; ++k)
+        is_code[k] = 1;
+      int bad = 0;
+      for (uint32_t k = pc + 1; k < next; ++k)
+        if ((uint32_t)mem[k] >= MEM_SIZE)
+        {
+          proof_fail(p, pc, "%s com operando fora da memória (%d)", ISA[op].mnemonic, mem[k]);
+          bad = 1;
+        }
+      if (bad || isa_stops(op))
+        break;
+      if (isa_jumps(op))
+      {
+        uint32_t t = (uint32_t)mem[pc + 1];
+        leader[t] = 1;
+        if (!is_instr[t])
+          work[top++] = t;
+        if (isa_ends_flow(op))
+          break;
+        leader[next] = 1;
+      }
+      if (next == MEM_SIZE)
+      {
+        proof_fail(p, pc, "execução segue para fora da memória");
+        break;
+      }
+      pc = next;
+    }
+  }
+
+  // escrita em código só pode ser checada depois de conhecer todo o código
+  for (uint32_t pc = 0; pc < MEM_SIZE; ++pc)
+  {
+    if (is_code[pc])
+      ++p->n_code;
+    if (!is_instr[pc])
+      continue;
+    int32_t op = mem[pc];
+    if (!isa_writes(op))
+      continue;
+    uint32_t w = (uint32_t)mem[pc + ISA[op].operands];
+    if (w < MEM_SIZE && is_code[w])
+      proof_fail(p, pc, "%s escreve no código (endereço %u)", ISA[op].mnemonic, w);
+  }
+
+  /*
+   * Tamanho da sequência linear que começa em cada instrução alcançável:
+   * segue o fluxo sem desvio até o primeiro JMP/JMPN/JMPP/JMPZ/STOP. Como o
+   * sucessor está sempre à frente, uma varredura de trás para frente basta.
+   * Só é usado quando a prova vale (o código então não muda).
+   */
+  for (uint32_t pc = MEM_SIZE; pc-- > 0;)
+  {
+    if (!is_instr[pc])
+      continue;
+    int32_t op = mem[pc];
+    uint32_t next = pc + op_size(op);
+    int ends = isa_jumps(op) || isa_stops(op) || next >= MEM_SIZE || !is_instr[next];
+    img->run_len[pc] = ends ? 1 : (RunLen)(1 + img->run_len[next]);
+  }
+
+  /*
+   * Sem endereçamento indireto, as escritas de uma imagem verificada só
+   * alcançam os operandos de STORE/COPY/INPUT: vm_reset restaura só essas
+   * páginas. Sem a prova, qualquer página pode mudar.
+   */
+  if (p->ok)
+  {
+    memset(img->write_page, 0, sizeof img->write_page);
+    for (uint32_t pc = 0; pc < MEM_SIZE; ++pc)
+    {
+      if (!is_instr[pc])
+        continue;
+      int32_t op = mem[pc];
+      if (isa_writes(op))
+        img->write_page[(uint32_t)mem[pc + ISA[op].operands] / VM_PAGE_WORDS] = 1;
+    }
+  }
+  free(work);
+  free(is_instr);
+  free(is_code);
+}
+
+/*
+ * Memória paginada. Imagens, memórias das VMs e registros do motor threaded
+ * são mapeamentos reservados com MAP_NORESERVE: páginas nunca tocadas não
+ * ocupam memória e são lidas como zero. As palavras da imagem ficam em um
+ * memfd; vm_load mapeia esse arquivo como privado (MAP_PRIVATE) sobre
+ * vm->mem, então as VMs compartilham as páginas da imagem e o núcleo copia
+ * uma página só na primeira escrita. Depois disso a página é da Vm e o
+ * acesso é direto, sem custo nos motores, que continuam vendo um vetor.
+ * Sem memfd, a imagem é memória anônima e vm_load copia as palavras.
+ */
+static void *map_anon(size_t bytes)
+{
+  void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+/* Devolve as páginas ao sistema; elas voltam a ser lidas como zero (ou como o arquivo mapeado). */
+static void map_zero(void *p, size_t bytes)
+{
+  madvise(p, bytes, MADV_DONTNEED);
+}
+
+/* Troca o conteúdo de [p, p + bytes) por uma cópia privada do arquivo fd. */
+static int map_private(void *p, size_t bytes, int fd)
+{
+  return mmap(p, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED | MAP_NORESERVE, fd, 0) != MAP_FAILED;
+}
+
+/* memfd com bytes zerados, mapeado como compartilhado em *map; -1 se não há memfd. */
+static int memfd_new(const char *name, size_t bytes, void **map)
+{
+  int fd = memfd_create(name, MFD_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, (off_t)bytes) == 0)
+    p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+  {
+    close(fd);
+    return -1;
+  }
+  *map = p;
+  return fd;
+}
+
+#define IMAGE_BYTES ((size_t)MEM_SIZE * sizeof(int32_t))
+
+/* Zera as palavras da imagem sem tocar nas páginas. */
+static void image_clear(Image *img)
+{
+  if (img->fd >= 0 && ftruncate(img->fd, 0) == 0 && ftruncate(img->fd, (off_t)IMAGE_BYTES) == 0)
+    return;
+  map_zero(img->words, IMAGE_BYTES);
+}
+
+Image *image_new(void)
+{
+  Image *img = (Image *)calloc(1, sizeof(Image));
+  if (!img)
+    return NULL;
+  void *words = NULL;
+  img->fd = memfd_new("sbvm-image", IMAGE_BYTES, &words);
+  if (img->fd < 0)
+    words = map_anon(IMAGE_BYTES);
+  if (!words)
+  {
+    free(img);
+    return NULL;
+  }
+  img->words = (int32_t *)words;
+  return img;
+}
+
+void image_free(Image *img)
+{
+  if (!img)
+    return;
+  munmap(img->words, IMAGE_BYTES);
+  if (img->fd >= 0)
+    close(img->fd);
+  free(img);
+}
+
+/* Aceita .o2b (detectado pelo cabeçalho) ou o .o2 textual. */
+int image_load(Image *img, const char *path, const char **why)
+{
+  *why = NULL;
+  image_clear(img);
+  int r = load_o2b(path, img->words, img, why);
+  if (r == 0)
+  {
+    img->entry = 0;
+    img->code_end = 0;
+    r = read_all_ints(path, img->words, &img->n);
+    if (r < 0)
+      *why = "programa maior que MEM_SIZE";
+  }
+  if (r <= 0)
+    return 0;
+  if (img->n == 0)
+  {
+    *why = "arquivo .o2 vazio.";
+    return 0;
+  }
+  verify_image(img);
+  return 1;
+}
+
+int image_set_words(Image *img, const int32_t *words, size_t n, const char **why)
+{
+  *why = NULL;
+  if (n == 0 || n > MEM_SIZE)
+  {
+    *why = n ? "programa maior que MEM_SIZE" : "programa vazio";
+    return 0;
+  }
+  image_clear(img);
+  memcpy(img->words, words, n * sizeof(int32_t));
+  img->n = n;
+  img->entry = 0;
+  img->code_end = 0;
+  verify_image(img);
+  return 1;
+}
+
+/*
+ * Registros do motor threaded (ver run_threaded). Ficam aqui porque cada
+ * Vm tem a sua própria tabela.
+ */
+#define MAX_SPAN 6
+#define REWRITE_LIMIT 4 // invalidações de uma palavra até ela deixar de ser decodificada de antemão
+
+struct Slot
+{
+  const void *h;    // rótulo do handler (computed goto)
+  uint32_t a, b, c; // operandos já validados
+  int32_t op;       // opcode da primeira instrução
+};
+
+typedef struct
+{
+  const char *name;
+  int n;          // instruções fundidas, todas de 2 palavras
+  int32_t ops[3];
+} Fusion;
+
+/* Em ordem de preferência: a primeira que casar é usada. */
+static const Fusion FUSIONS[] = {
+    {"LOAD ADD STORE", 3, {10, 1, 11}},
+    {"LOAD SUB STORE", 3, {10, 2, 11}},
+    {"LOAD SUB JMPZ", 3, {10, 2, 8}},
+    {"LOAD SUB JMPN", 3, {10, 2, 6}},
+    {"LOAD SUB JMPP", 3, {10, 2, 7}},
+    {"LOAD STORE", 2, {10, 11}},
+};
+#define N_FUSIONS ((int)(sizeof FUSIONS / sizeof FUSIONS[0]))
+static_assert(N_FUSIONS == VM_FUSIONS, "VM_FUSIONS (sbvm.h) deve acompanhar FUSIONS");
+static_assert(VM_FUSIONS <= 8, "Vm::fused_at guarda um bit por sequência em um byte");
+
+/*
+ * Trace binário (--trace-file): registros de tamanho fixo (SbtRecord) em
+ * um buffer circular em memória. Sem --trace-last o buffer é despejado no
+ * arquivo sempre que enche; com --trace-last=N ele guarda só os últimos N
+ * registros, gravados ao final da execução (inclusive em erro).
+ */
+#define TRACE_CHUNK 4096
+
+struct Tracer
+{
+  FILE *out;
+  SbtRecord *ring;
+  size_t cap, head, len;
+  int ring_mode;
+  uint32_t lo, hi;      // faixa de PCs
+  uint64_t every;       // um registro a cada every passos
+  uint64_t total;       // registros produzidos
+  uint64_t written;     // registros já gravados
+  SbtRecord *pending;   // escrita cujo valor só se conhece no passo seguinte
+};
+
+void vm_config_default(VmConfig *cfg)
+{
+  cfg->engine = ENGINE_THREADED;
+  cfg->max_steps = 10000000LL; // 10 milhões
+  cfg->fusion = 1;
+  cfg->verify = 1;
+  cfg->trace = 0;
+}
+
+static void jit_free(Jit *j);
+
+#define SLOTS_BYTES ((size_t)(MEM_SIZE + 1) * sizeof(Slot))
+
+void vm_free(Vm *vm)
+{
+  io_reset(&vm->io, -1, -1, 0);
+  free(vm->io.cap);
+  if (vm->mem)
+    munmap(vm->mem, IMAGE_BYTES);
+  if (vm->code)
+    munmap(vm->code, SLOTS_BYTES);
+  if (vm->covered)
+    munmap(vm->covered, MEM_SIZE);
+  if (vm->fused_at)
+    munmap(vm->fused_at, MEM_SIZE);
+  if (vm->rewrites)
+    munmap(vm->rewrites, MEM_SIZE);
+  if (vm->brk)
+    munmap(vm->brk, MEM_SIZE);
+  if (vm->watch)
+    munmap(vm->watch, MEM_SIZE);
+  jit_free(vm->jit);
+  free(vm->prof);
+  if (vm->runs)
+    munmap(vm->runs, MEM_SIZE * sizeof(uint64_t));
+  munmap(vm, sizeof(Vm));
+}
+
+Vm *vm_new(const VmConfig *cfg)
+{
+  Vm *vm = (Vm *)map_anon(sizeof(Vm)); // os buffers de E/S só ocupam memória quando usados
+  if (!vm)
+    return NULL;
+  vm->cfg = *cfg;
+  vm->mem = (int32_t *)map_anon(IMAGE_BYTES);
+  vm->code = (Slot *)map_anon(SLOTS_BYTES);
+  vm->covered = (uint8_t *)map_anon(MEM_SIZE);
+  vm->fused_at = (uint8_t *)map_anon(MEM_SIZE);
+  vm->rewrites = (uint8_t *)map_anon(MEM_SIZE);
+  vm->io.in_fd = -1;
+  if (!vm->mem || !vm->code || !vm->covered || !vm->fused_at || !vm->rewrites)
+  {
+    vm_free(vm);
+    return NULL;
+  }
+  return vm;
+}
+
+void vm_set_io(Vm *vm, VmInputFn in, VmOutputFn out, void *ctx)
+{
+  vm->io.in_fn = in;
+  vm->io.out_fn = out;
+  vm->io.fn_ctx = ctx;
+}
+
+int vm_enable_profile(Vm *vm)
+{
+  if (!vm->prof)
+    vm->prof = (Profile *)calloc(1, sizeof(Profile));
+  return vm->prof != NULL;
+}
+
+int vm_enable_op_counts(Vm *vm)
+{
+  if (!vm->runs)
+    vm->runs = (uint64_t *)map_anon(MEM_SIZE * sizeof(uint64_t));
+  vm->runs_ok = 1;
+  return vm->runs != NULL;
+}
+
+int vm_op_counts(const Vm *vm, uint64_t ops[ISA_MAX_OPCODE + 1])
+{
+  if (!vm->runs || !vm->runs_ok)
+    return 0;
+  if (!ops)
+    return 1;
+  const Image *img = vm->img;
+  memset(ops, 0, (ISA_MAX_OPCODE + 1) * sizeof(uint64_t));
+  // código verificado não muda: a sequência que começa em pc está em img->words
+  for (uint32_t pc = 0; pc < img->n && pc < MEM_SIZE; ++pc)
+  {
+    uint64_t hits = vm->runs[pc];
+    if (!hits)
+      continue;
+    uint32_t p = pc;
+    for (RunLen k = img->run_len[pc]; k > 0; --k)
+    {
+      ops[img->words[p]] += hits;
+      p += op_size(img->words[p]);
+    }
+  }
+  return 1;
+}
+
+void vm_load(Vm *vm, const Image *img)
+{
+  vm->img = img;
+  // as páginas privadas da execução anterior são descartadas
+  if (img->fd < 0 || !map_private(vm->mem, IMAGE_BYTES, img->fd))
+  {
+    map_zero(vm->mem, IMAGE_BYTES);
+    memcpy(vm->mem, img->words, img->n * sizeof(int32_t));
+  }
+  vm->cpu.ACC = 0;
+  vm->cpu.PC = img->entry;
+  vm->cpu.steps = 0;
+  vm->limit = vm->cfg.max_steps;
+  vm->verified = vm->cfg.verify && img->proof.ok;
+  vm->err[0] = 0;
+  vm->brk_skip = 0;
+  vm->decoded = NULL;
+  vm->jit_valid = 0;
+  memset(vm->fusion_sites, 0, sizeof vm->fusion_sites);
+  memset(vm->fusion_hits, 0, sizeof vm->fusion_hits);
+  map_zero(vm->fused_at, MEM_SIZE);
+  map_zero(vm->rewrites, MEM_SIZE);
+  if (vm->runs)
+    map_zero(vm->runs, MEM_SIZE * sizeof(uint64_t));
+  vm->runs_ok = 1;
+}
+
+void vm_reset(Vm *vm)
+{
+  const Image *img = vm->img;
+  if (!img->proof.ok)
+  {
+    vm_load(vm, img); // código pode ter mudado: registros e blocos não valem mais
+    return;
+  }
+  for (uint32_t p = 0; p < VM_PAGES; ++p)
+    if (img->write_page[p])
+      memcpy(vm->mem + p * VM_PAGE_WORDS, img->words + p * VM_PAGE_WORDS, VM_PAGE_WORDS * sizeof(int32_t));
+  vm->cpu.ACC = 0;
+  vm->cpu.PC = img->entry;
+  vm->cpu.steps = 0;
+  vm->limit = vm->cfg.max_steps;
+  vm->err[0] = 0;
+  vm->brk_skip = 0;
+  memset(vm->fusion_hits, 0, sizeof vm->fusion_hits);
+  if (vm->runs)
+    map_zero(vm->runs, MEM_SIZE * sizeof(uint64_t));
+  vm->runs_ok = 1;
+}
+
+/* Fim da execução: grava o estado final e, se fmt != NULL, o erro. */
+static int vm_exit(Vm *vm, int32_t acc, uint32_t pc, long long steps, const char *fmt, ...)
+{
+  vm->cpu.ACC = acc;
+  vm->cpu.PC = pc;
+  vm->cpu.steps = steps;
+  if (!fmt)
+    return 0;
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(vm->err, sizeof vm->err, fmt, ap);
+  va_end(ap);
+  return 1;
+}
+
+/*
+ * Passo limit + 1 alcançado: pausa antes de executá-lo se limit é só um
+ * ponto de parada, senão é o erro de limite de passos. steps já conta a
+ * instrução que não será executada.
+ */
+static int vm_step_limit(Vm *vm, int32_t acc, uint32_t pc, long long steps)
+{
+  if (vm->limit < vm->cfg.max_steps)
+  {
+    vm_exit(vm, acc, pc, steps - 1, NULL);
+    return VM_PAUSED;
+  }
+  return vm_exit(vm, acc, pc, steps, "Erro: limite de passos excedido");
+}
+
+/* Breakpoint em pc: para antes de executá-lo; steps = instruções já executadas. */
+static int vm_break_stop(Vm *vm, int32_t acc, uint32_t pc, long long steps)
+{
+  vm->brk_skip = pc + 1;
+  vm_exit(vm, acc, pc, steps, NULL);
+  return VM_BREAK;
+}
+
+/* Escrita em endereço vigiado: para logo depois da instrução. */
+static int vm_watch_stop(Vm *vm, int32_t acc, uint32_t pc, long long steps, uint32_t addr)
+{
+  vm->watch_hit = addr;
+  vm_exit(vm, acc, pc, steps, NULL);
+  return VM_WATCH;
+}
+
+/* INPUT/OUTPUT em pc bloquearia: para antes dele; steps = instruções já executadas. */
+static int vm_wait(Vm *vm, int32_t acc, uint32_t pc, long long steps, int why)
+{
+  vm_exit(vm, acc, pc, steps, NULL);
+  return why;
+}
+
+int vm_trace_open(Vm *vm, const char *path, long long last, uint32_t lo, uint32_t hi, long long every)
+{
+  if (MEM_SIZE - 1 > SBT_MAX_PC)
+    return 0;
+  Tracer *t = (Tracer *)calloc(1, sizeof(Tracer));
+  if (!t)
+    return 0;
+  t->ring_mode = last > 0;
+  t->cap = t->ring_mode ? (size_t)last : TRACE_CHUNK;
+  t->ring = (SbtRecord *)malloc(t->cap * sizeof(SbtRecord));
+  t->lo = lo;
+  t->hi = hi;
+  t->every = every > 0 ? (uint64_t)every : 1;
+  t->out = t->ring ? fopen(path, "wb") : NULL;
+  if (!t->out)
+  {
+    free(t->ring);
+    free(t);
+    return 0;
+  }
+  SbtHeader h;
+  memset(&h, 0, sizeof h); // totais regravados em vm_trace_close
+  fwrite(&h, sizeof h, 1, t->out);
+  vm->tracer = t;
+  return 1;
+}
+
+static void trace_drain(Tracer *t)
+{
+  size_t first = t->len < t->cap - t->head ? t->len : t->cap - t->head;
+  fwrite(t->ring + t->head, sizeof(SbtRecord), first, t->out);
+  fwrite(t->ring, sizeof(SbtRecord), t->len - first, t->out);
+  t->written += t->len;
+  t->head = t->len = 0;
+}
+
+/* Registro do passo step (1 = primeira instrução), antes de executá-lo. */
+static void trace_step(Vm *vm, long long step, uint32_t pc, int32_t acc)
+{
+  const int32_t *mem = vm->mem;
+  if (vm->cfg.trace)
+    fprintf(stderr, "[trace] PC=%u ACC=%d OPC=%d\n", pc, acc, mem[pc]);
+  Tracer *t = vm->tracer;
+  if (!t)
+    return;
+  if (t->pending)
+  {
+    t->pending->value = mem[t->pending->addr];
+    t->pending = NULL;
+  }
+  if (pc < t->lo || pc > t->hi || (uint64_t)(step - 1) % t->every)
+    return;
+
+  SbtRecord *r;
+  if (t->len < t->cap)
+    r = &t->ring[(t->head + t->len++) % t->cap];
+  else if (t->ring_mode)
+  {
+    r = &t->ring[t->head]; // sobrescreve o mais antigo
+    t->head = (t->head + 1) % t->cap;
+  }
+  else
+  {
+    trace_drain(t);
+    r = &t->ring[t->len++];
+  }
+  ++t->total;
+
+  int32_t op = mem[pc];
+  r->step = (uint64_t)step;
+  r->pc = (uint16_t)pc;
+  r->op = (uint8_t)(isa_opcode(op) ? op : 0);
+  r->flags = 0;
+  r->acc = acc;
+  r->addr = 0;
+  r->value = 0;
+  if (!isa_opcode(op) || ISA[op].operands == 0)
+    return;
+  // o operando que a instrução escreve (COPY: o segundo) ou lê
+  uint32_t last = pc + ISA[op].operands;
+  uint32_t a = last < MEM_SIZE ? (uint32_t)mem[last] : MEM_SIZE;
+  r->addr = a;
+  if (a >= MEM_SIZE)
+    return; // operando inválido: o motor reporta o erro
+  if (isa_jumps(op))
+    r->flags = SBT_JUMP;
+  else if (isa_writes(op))
+  {
+    r->flags = SBT_WRITE;
+    r->value = mem[a];
+    t->pending = r;
+  }
+  else
+  {
+    r->flags = SBT_READ;
+    r->value = mem[a];
+  }
+}
+
+void vm_trace_close(Vm *vm)
+{
+  Tracer *t = vm->tracer;
+  if (!t)
+    return;
+  if (t->pending)
+    t->pending->value = vm->mem[t->pending->addr];
+  trace_drain(t);
+  SbtHeader h;
+  memcpy(h.magic, SBT_MAGIC, 4);
+  h.version = SBT_VERSION;
+  h.record_size = sizeof(SbtRecord);
+  h.flags = t->ring_mode ? SBT_RING : 0;
+  h.every = (uint32_t)t->every;
+  h.total = t->total;
+  h.written = t->written;
+  fseek(t->out, 0, SEEK_SET);
+  fwrite(&h, sizeof h, 1, t->out);
+  fclose(t->out);
+  free(t->ring);
+  free(t);
+  vm->tracer = NULL;
+}
+
+static void jit_code_write(Vm *vm, uint32_t x);
+
+/*
+ * Motor de referência: relê mem[PC] a cada passo. Com CHECKED, valida PC e
+ * operandos como sempre; sem, é o caminho rápido para imagens verificadas.
+ * TRACE liga o --trace textual e o trace binário (trace_step). JIT_SMC: o
+ * motor jit passou a vez por um trecho de código automodificável, e
+ * escritas em blocos traduzidos os invalidam (jit_code_write).
+ */
+template <bool CHECKED, bool TRACE, bool JIT_SMC = false>
+static int switch_loop(Vm *vm)
+{
+  int32_t *mem = vm->mem;
+  Io *io = &vm->io;
+  const long long limit = vm->limit;
+  int32_t ACC = vm->cpu.ACC;
+  uint32_t PC = vm->cpu.PC;
+  long long steps = vm->cpu.steps;
+  const uint8_t *const brk = vm->n_brk ? vm->brk : NULL;
+  const uint8_t *const watch = vm->n_watch ? vm->watch : NULL;
+
+#define FAIL(m) return vm_exit(vm, ACC, PC, steps, "Erro: " m)
+// depois de escrever em addr (PC já avançado)
+#define WROTE(addr)                                    \
+  do                                                   \
+  {                                                    \
+    if (JIT_SMC)                                       \
+      jit_code_write(vm, addr);                        \
+    if (watch && watch[addr])                          \
+      return vm_watch_stop(vm, ACC, PC, steps, addr); \
+  } while (0)
+  while (1)
+  {
+    if (steps++ > limit)
+      return vm_step_limit(vm, ACC, PC, steps);
+    if (CHECKED && PC >= MEM_SIZE)
+      FAIL("PC fora da memória");
+    if (brk && brk[PC])
+    {
+      if (vm->brk_skip != PC + 1)
+        return vm_break_stop(vm, ACC, PC, steps - 1);
+      vm->brk_skip = 0;
+    }
+    int32_t op = mem[PC];
+    if (TRACE)
+      trace_step(vm, steps, PC, ACC);
+
+    switch (op)
+    {
+    case 1:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("ADD end");
+      ACC += mem[a];
+      PC += 2;
+      break;
+    } // ADD
+    case 2:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("SUB end");
+      ACC -= mem[a];
+      PC += 2;
+      break;
+    } // SUB
+    case 3:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("MUL end");
+      ACC *= mem[a];
+      PC += 2;
+      break;
+    } // MUL
+    case 4:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("DIV end");
+      if (mem[a] == 0)
+        FAIL("DIV zero");
+      if (mem[a] == -1 && ACC == INT32_MIN)
+        FAIL("DIV overflow");
+      ACC /= mem[a];
+      PC += 2;
+      break;
+    } // DIV
+    case 5:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("JMP end");
+      PC = a;
+      break;
+    } // JMP
+    case 6:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("JMPN end");
+      PC = (ACC < 0) ? a : (PC + 2);
+      break;
+    } // JMPN
+    case 7:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("JMPP end");
+      PC = (ACC > 0) ? a : (PC + 2);
+      break;
+    } // JMPP
+    case 8:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("JMPZ end");
+      PC = (ACC == 0) ? a : (PC + 2);
+      break;
+    } // JMPZ
+    case 9:
+    {
+      uint32_t a = mem[PC + 1], b = mem[PC + 2];
+      if (CHECKED && (a >= MEM_SIZE || b >= MEM_SIZE))
+        FAIL("COPY end");
+      mem[b] = mem[a];
+      PC += 3;
+      WROTE(b);
+      break;
+    } // COPY
+    case 10:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("LOAD end");
+      ACC = mem[a];
+      PC += 2;
+      break;
+    } // LOAD
+    case 11:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("STORE end");
+      mem[a] = ACC;
+      PC += 2;
+      WROTE(a);
+      break;
+    } // STORE
+    case 12:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("INPUT end");
+      long long v;
+      int got = io_read_int(io, steps, &v);
+      if (got < 0)
+        return vm_wait(vm, ACC, PC, steps - 1, VM_WAIT_INPUT);
+      if (!got)
+        FAIL("INPUT falha");
+      mem[a] = (int32_t)v;
+      PC += 2;
+      WROTE(a);
+      break;
+    } // INPUT
+    case 13:
+    {
+      uint32_t a = mem[PC + 1];
+      if (CHECKED && a >= MEM_SIZE)
+        FAIL("OUTPUT end");
+      if (io_write_int(io, mem[a]) < 0)
+        return vm_wait(vm, ACC, PC, steps - 1, VM_WAIT_OUTPUT);
+      PC += 2;
+      break;
+    } // OUTPUT
+    case 14:
+    {
+      return vm_exit(vm, ACC, PC, steps, NULL);
+    } // STOP
+    default:
+    {
+      return vm_exit(vm, ACC, PC, steps, "Opcode desconhecido %d em PC=%u", op, PC);
+    }
+    }
+  }
+#undef WROTE
+#undef FAIL
+}
+
+static int run_switch(Vm *vm)
+{
+  const int trace = vm->cfg.trace || vm->tracer;
+  if (vm->verified)
+    return trace ? switch_loop<false, true>(vm) : switch_loop<false, false>(vm);
+  return trace ? switch_loop<true, true>(vm) : switch_loop<true, false>(vm);
+}
+
+/*
+ * Motor "threaded": cada endereço tem um registro pré-decodificado com o
+ * rótulo do handler e os operandos já validados. A decodificação é feita
+ * uma vez, na primeira execução do endereço; o despacho é um único
+ * "goto *slot->h". Operando fora da memória ou opcode inválido viram
+ * handlers de erro, então nenhum handler refaz checagem de limites.
+ *
+ * Código automodificável: covered[x] marca palavras que fazem parte de
+ * alguma instrução decodificada. Uma escrita (STORE/COPY/INPUT) em x com
+ * covered[x] devolve ao estado "não decodificado" todo registro que pode
+ * conter x (de x - MAX_SPAN + 1 até x). rewrites[x] conta essas
+ * invalidações: um operando que o programa reescreve a cada volta de um
+ * laço (usado como ponteiro) passa, a partir de REWRITE_LIMIT, a ser relido
+ * a cada execução (op_dyn), sem marcar covered nem entrar em superinstrução.
+ *
+ * Superinstruções: ao decodificar um LOAD, se as instruções seguintes do
+ * mesmo bloco básico formam uma sequência de FUSIONS, o registro recebe um
+ * handler fundido que executa a sequência inteira com um único despacho.
+ * Os líderes (alvos de salto e sucessores de desvios) vêm da passada do
+ * verificador sobre o grafo de controle, feita na carga.
+ *
+ * Com PROFILE, cada handler também atualiza os contadores de vm->prof; a
+ * fusão fica desligada para que toda instrução seja contada no seu PC.
+ *
+ * Com BLOCKS (imagem verificada, sem perfil), os passos são cobrados por
+ * sequência linear: ao entrar por um desvio, DISPATCH soma run_len[PC] de
+ * uma vez e os handlers que seguem em frente usam NEXT, sem contar nem
+ * comparar. Se o orçamento não cobre a sequência inteira, ela é executada
+ * pelo motor de referência, instrução a instrução, até a pausa ou o erro
+ * de limite. Um erro no meio da sequência devolve os passos não executados.
+ *
+ * Com RUNS (vm_enable_op_counts), DISPATCH também soma 1 em runs[PC]:
+ * vm_op_counts conta a sequência de PC até o fim. Ao sair no meio dela,
+ * LEAVE desconta a parte cobrada e não executada (runs_uncount).
+ */
+/*
+ * Volta todos os registros ao estado "não decodificado". Cada instância de
+ * threaded_loop tem o seu rótulo decode, e para cada uma há um modelo (um
+ * memfd com todos os registros apontando para decode e o último para
+ * pc_out) que é mapeado como privado sobre vm->code: só os registros de
+ * código que roda viram páginas da Vm.
+ */
+static int slots_template(const void *decode, const void *pc_out)
+{
+  void *map;
+  int fd = memfd_new("sbvm-slots", SLOTS_BYTES, &map);
+  if (fd < 0)
+    return -1;
+  Slot *code = (Slot *)map;
+  for (uint32_t i = 0; i < MEM_SIZE; ++i)
+    code[i].h = decode;
+  code[MEM_SIZE].h = pc_out;
+  munmap(map, SLOTS_BYTES);
+  return fd;
+}
+
+static void slots_reset(Vm *vm, int fd, const void *decode, const void *pc_out)
+{
+  map_zero(vm->covered, MEM_SIZE);
+  if (fd >= 0 && map_private(vm->code, SLOTS_BYTES, fd))
+    return;
+  for (uint32_t i = 0; i < MEM_SIZE; ++i)
+    vm->code[i].h = decode;
+  vm->code[MEM_SIZE].h = pc_out;
+}
+
+static void invalidate(Vm *vm, uint32_t x, const void *decode)
+{
+  vm->covered[x] = 0;
+  if (vm->rewrites[x] < REWRITE_LIMIT)
+    ++vm->rewrites[x];
+  for (uint32_t k = 0; k < MAX_SPAN && k <= x; ++k)
+    vm->code[x - k].h = decode;
+}
+
+/*
+ * Liga/desliga um ponto em um dos mapas de depuração. Os registros que
+ * podem conter pc voltam a "não decodificado" e, na próxima passagem, o
+ * decode põe (ou tira) o handler de parada.
+ */
+static int debug_mark(Vm *vm, uint8_t **map, int *count, uint32_t x, int on)
+{
+  if (x >= MEM_SIZE)
+    return 0;
+  if (!*map && !(*map = (uint8_t *)map_anon(MEM_SIZE)))
+    return 0;
+  on = on != 0;
+  if ((*map)[x] == on)
+    return 1;
+  (*map)[x] = (uint8_t)on;
+  *count += on ? 1 : -1;
+  if (map == &vm->brk && vm->decoded)
+    invalidate(vm, x, vm->decoded);
+  return 1;
+}
+
+int vm_break(Vm *vm, uint32_t pc, int on)
+{
+  return debug_mark(vm, &vm->brk, &vm->n_brk, pc, on);
+}
+
+int vm_watch(Vm *vm, uint32_t addr, int on)
+{
+  return debug_mark(vm, &vm->watch, &vm->n_watch, addr, on);
+}
+
+/*
+ * Índice em FUSIONS da sequência que começa em pc, ou -1. Preenche a/b/c.
+ * Uma sequência com uma palavra que o programa reescreve sem parar (operando
+ * usado como ponteiro) não é fundida: cada escrita a decodificaria de novo.
+ */
+static int match_fusion(Vm *vm, uint32_t pc, Slot *s)
+{
+  const int32_t *mem = vm->mem;
+  const uint8_t *leader = vm->img->leader;
+  const uint8_t *rewrites = vm->rewrites;
+  for (int f = 0; f < N_FUSIONS; ++f)
+  {
+    const Fusion *fu = &FUSIONS[f];
+    if (pc + 2 * fu->n > MEM_SIZE || mem[pc] != fu->ops[0])
+      continue;
+    int ok = 1;
+    for (int i = 0; i < fu->n && ok; ++i)
+    {
+      uint32_t at = pc + 2 * i;
+      ok = mem[at] == fu->ops[i] && (uint32_t)mem[at + 1] < MEM_SIZE &&
+           rewrites[at] < REWRITE_LIMIT && rewrites[at + 1] < REWRITE_LIMIT &&
+           (i == 0 || (!leader[at] && !(vm->n_brk && vm->brk[at])));
+    }
+    if (!ok)
+      continue;
+    s->a = (uint32_t)mem[pc + 1];
+    s->b = (uint32_t)mem[pc + 3];
+    s->c = fu->n == 3 ? (uint32_t)mem[pc + 5] : 0;
+    if (!(vm->fused_at[pc] & (1u << f)))
+    {
+      vm->fused_at[pc] |= (uint8_t)(1u << f); // sítio novo, não uma nova decodificação
+      ++vm->fusion_sites[f];
+    }
+    return f;
+  }
+  return -1;
+}
+
+void vm_print_fusion_stats(const Vm *vm, FILE *out)
+{
+  for (int f = 0; f < N_FUSIONS; ++f)
+    fprintf(out, "[fusão] %-15s %8lld sítios %12lld execuções\n",
+            FUSIONS[f].name, vm->fusion_sites[f], vm->fusion_hits[f]);
+}
+
+/*
+ * Desconta de runs as últimas left instruções da sequência que contém pc:
+ * -1 na primeira delas, cujo run_len é left.
+ */
+static void runs_uncount(Vm *vm, uint32_t pc, long long left)
+{
+  const Image *img = vm->img;
+  if (left <= 0)
+    return;
+  while (img->run_len[pc] > left)
+    pc += op_size(img->words[pc]);
+  --vm->runs[pc];
+}
+
+/* Saída do laço com charged passos cobrados; vm->cpu.steps já tem os executados. */
+static int runs_leave(Vm *vm, uint32_t pc, long long charged, int rc)
+{
+  runs_uncount(vm, pc, charged - vm->cpu.steps);
+  return rc;
+}
+
+template <bool PROFILE, bool BLOCKS, bool RUNS>
+static int threaded_loop(Vm *vm)
+{
+  static_assert(!RUNS || BLOCKS, "RUNS conta as sequências cobradas por BLOCKS");
+  static const void *const handlers[] = {
+      &&op_bad, &&op_add, &&op_sub, &&op_mul, &&op_div, &&op_jmp, &&op_jmpn, &&op_jmpp,
+      &&op_jmpz, &&op_copy, &&op_load, &&op_store, &&op_input, &&op_output, &&op_stop};
+  // mesma ordem de FUSIONS
+  static const void *const fused[N_FUSIONS] = {
+      &&f_load_add_store, &&f_load_sub_store, &&f_load_sub_jmpz,
+      &&f_load_sub_jmpn, &&f_load_sub_jmpp, &&f_load_store};
+
+  int32_t *mem = vm->mem;
+  Slot *code = vm->code;
+  uint8_t *covered = vm->covered;
+  Io *io = &vm->io;
+  // retomando de uma pausa, os registros decodificados continuam valendo
+  if (vm->decoded != &&decode)
+  {
+    static const int slots_fd = slots_template(&&decode, &&pc_out); // um por instância
+    slots_reset(vm, slots_fd, &&decode, &&pc_out);
+    vm->decoded = &&decode;
+  }
+
+  int32_t ACC = vm->cpu.ACC;
+  uint32_t PC = vm->cpu.PC;
+  long long steps = vm->cpu.steps;
+  const long long max_steps = vm->limit;
+  const int fusion = vm->cfg.fusion && !PROFILE;
+  const int smc_guard = !vm->verified; // imagem verificada nunca escreve em código
+  const RunLen *const run_len = vm->img->run_len;
+  Profile *const prof = vm->prof;
+  uint64_t *const runs = vm->runs;
+  const uint8_t *const brk = vm->n_brk ? vm->brk : NULL;
+  const uint8_t *const watch = vm->n_watch ? vm->watch : NULL;
+  Slot *s;
+
+// passos até a instrução em PC, inclusive (BLOCKS já cobrou o resto da sequência)
+#define STEPS() (BLOCKS ? steps - run_len[PC] + 1 : steps)
+// sai do laço; com RUNS, desconta a parte da sequência cobrada e não executada
+#define LEAVE(rc) return RUNS ? runs_leave(vm, PC, steps, (rc)) : (rc)
+#define FAIL(m) LEAVE(vm_exit(vm, ACC, PC, STEPS(), "Erro: " m))
+#define DISPATCH()                                   \
+  do                                                 \
+  {                                                  \
+    if (BLOCKS)                                      \
+    {                                                \
+      if (steps + run_len[PC] - 1 > max_steps)       \
+        goto run_tail;                               \
+      steps += run_len[PC];                          \
+      if (RUNS)                                      \
+        ++runs[PC];                                  \
+    }                                                \
+    else if (steps++ > max_steps)                    \
+      goto step_limit;                               \
+    if (PROFILE)                                     \
+      ++prof->count[PC];                             \
+    s = &code[PC];                                   \
+    goto *s->h;                                      \
+  } while (0)
+// próxima instrução da mesma sequência linear
+#define NEXT()            \
+  do                      \
+  {                       \
+    if (!BLOCKS)          \
+      DISPATCH();         \
+    s = &code[PC];        \
+    goto *s->h;           \
+  } while (0)
+#define PROF(x)                           \
+  do                                      \
+  {                                       \
+    if (PROFILE)                          \
+    {                                     \
+      x;                                  \
+    }                                     \
+  } while (0)
+// escrita de dados; watchpoint para já com PC em PC + len (extra: instruções
+// de uma superinstrução antes da que escreve)
+#define WRITE(addr, val, len, extra)                                                        \
+  do                                                                                        \
+  {                                                                                         \
+    mem[addr] = (val);                                                                      \
+    if (smc_guard && covered[addr])                                                         \
+      invalidate(vm, (addr), &&decode);                                                     \
+    if (watch && watch[addr])                                                               \
+      LEAVE(vm_watch_stop(vm, ACC, PC + (len), BLOCKS ? STEPS() + (extra) : steps, (addr)));  \
+  } while (0)
+
+  DISPATCH();
+
+decode:
+{
+  int32_t op = mem[PC];
+  s->op = op;
+  if (!isa_opcode(op))
+  {
+    s->h = brk && brk[PC] ? &&op_break : &&op_bad;
+    goto *s->h;
+  }
+  int size = op_size(op);
+  s->h = handlers[op];
+  if (size >= 2)
+  {
+    s->a = PC + 1 < MEM_SIZE ? (uint32_t)mem[PC + 1] : MEM_SIZE;
+    if (s->a >= MEM_SIZE)
+      s->h = &&op_badarg;
+  }
+  if (size == 3)
+  {
+    s->b = PC + 2 < MEM_SIZE ? (uint32_t)mem[PC + 2] : MEM_SIZE;
+    if (s->b >= MEM_SIZE)
+      s->h = &&op_badarg;
+  }
+  if (op == 10 && fusion && s->h == handlers[op] && !(brk && brk[PC]))
+  {
+    int f = match_fusion(vm, PC, s);
+    if (f >= 0)
+    {
+      s->h = fused[f];
+      size = 2 * FUSIONS[f].n;
+    }
+  }
+  int dyn = 0; // operando reescrito sem parar: relido a cada execução
+  if (smc_guard && size == op_size(op) && !(brk && brk[PC]))
+    for (int k = 1; k < size; ++k)
+      dyn |= vm->rewrites[PC + k] >= REWRITE_LIMIT;
+  if (dyn)
+  {
+    s->h = &&op_dyn;
+    covered[PC] = 1; // o opcode ainda é decodificado de antemão
+  }
+  else
+    for (int k = 0; k < size && PC + k < MEM_SIZE; ++k)
+      covered[PC + k] = 1;
+  if (brk && brk[PC])
+    s->h = &&op_break; // operandos já decodificados para quando retomar
+  goto *s->h;
+}
+
+op_dyn:
+  s->a = (uint32_t)mem[PC + 1];
+  s->b = op_size(s->op) == 3 ? (uint32_t)mem[PC + 2] : 0;
+  if (s->a >= MEM_SIZE || s->b >= MEM_SIZE)
+    goto op_badarg;
+  goto *handlers[s->op];
+
+op_add:
+  PROF(++prof->ops[1]; ++prof->reads[s->a]);
+  ACC += mem[s->a];
+  PC += 2;
+  NEXT();
+op_sub:
+  PROF(++prof->ops[2]; ++prof->reads[s->a]);
+  ACC -= mem[s->a];
+  PC += 2;
+  NEXT();
+op_mul:
+  PROF(++prof->ops[3]; ++prof->reads[s->a]);
+  ACC *= mem[s->a];
+  PC += 2;
+  NEXT();
+op_div:
+  PROF(++prof->ops[4]; ++prof->reads[s->a]);
+  if (mem[s->a] == 0)
+    FAIL("DIV zero");
+  if (mem[s->a] == -1 && ACC == INT32_MIN)
+    FAIL("DIV overflow");
+  ACC /= mem[s->a];
+  PC += 2;
+  NEXT();
+op_jmp:
+  PROF(++prof->ops[5]; ++prof->taken[PC]);
+  PC = s->a;
+  DISPATCH();
+op_jmpn:
+  PROF(++prof->ops[6]; prof->taken[PC] += ACC < 0);
+  PC = (ACC < 0) ? s->a : (PC + 2);
+  DISPATCH();
+op_jmpp:
+  PROF(++prof->ops[7]; prof->taken[PC] += ACC > 0);
+  PC = (ACC > 0) ? s->a : (PC + 2);
+  DISPATCH();
+op_jmpz:
+  PROF(++prof->ops[8]; prof->taken[PC] += ACC == 0);
+  PC = (ACC == 0) ? s->a : (PC + 2);
+  DISPATCH();
+op_copy:
+  PROF(++prof->ops[9]; ++prof->reads[s->a]; ++prof->writes[s->b]);
+  WRITE(s->b, mem[s->a], 3, 0);
+  PC += 3;
+  NEXT();
+op_load:
+  PROF(++prof->ops[10]; ++prof->reads[s->a]);
+  ACC = mem[s->a];
+  PC += 2;
+  NEXT();
+op_store:
+  PROF(++prof->ops[11]; ++prof->writes[s->a]);
+  WRITE(s->a, ACC, 2, 0);
+  PC += 2;
+  NEXT();
+op_input:
+{
+  PROF(++prof->ops[12]; ++prof->writes[s->a]);
+  long long v;
+  int got = io_read_int(io, STEPS(), &v);
+  if (got < 0)
+    LEAVE(vm_wait(vm, ACC, PC, STEPS() - 1, VM_WAIT_INPUT));
+  if (!got)
+    FAIL("INPUT falha");
+  WRITE(s->a, (int32_t)v, 2, 0);
+  PC += 2;
+  NEXT();
+}
+op_output:
+  PROF(++prof->ops[13]; ++prof->reads[s->a]);
+  if (io_write_int(io, mem[s->a]) < 0)
+    LEAVE(vm_wait(vm, ACC, PC, STEPS() - 1, VM_WAIT_OUTPUT));
+  PC += 2;
+  NEXT();
+op_stop:
+  PROF(++prof->ops[14]);
+  LEAVE(vm_exit(vm, ACC, PC, STEPS(), NULL));
+
+  /*
+   * Handlers fundidos. DISPATCH já contou a primeira instrução; se o limite
+   * de passos cair no meio da sequência, executa só o LOAD pelo handler
+   * comum e deixa os registros seguintes fazerem a contagem exata. Com
+   * BLOCKS a sequência inteira já foi cobrada.
+   */
+#define FUSED(f, n)                                  \
+  if (!BLOCKS && steps + (n)-2 > max_steps)          \
+    goto *handlers[s->op];                           \
+  if (!BLOCKS)                                       \
+    steps += (n)-1;                                  \
+  ++vm->fusion_hits[f]
+
+f_load_add_store:
+  FUSED(0, 3);
+  ACC = mem[s->a];
+  ACC += mem[s->b];
+  WRITE(s->c, ACC, 6, 2);
+  PC += 6;
+  NEXT();
+f_load_sub_store:
+  FUSED(1, 3);
+  ACC = mem[s->a];
+  ACC -= mem[s->b];
+  WRITE(s->c, ACC, 6, 2);
+  PC += 6;
+  NEXT();
+f_load_sub_jmpz:
+  FUSED(2, 3);
+  ACC = mem[s->a];
+  ACC -= mem[s->b];
+  PC = (ACC == 0) ? s->c : (PC + 6);
+  DISPATCH();
+f_load_sub_jmpn:
+  FUSED(3, 3);
+  ACC = mem[s->a];
+  ACC -= mem[s->b];
+  PC = (ACC < 0) ? s->c : (PC + 6);
+  DISPATCH();
+f_load_sub_jmpp:
+  FUSED(4, 3);
+  ACC = mem[s->a];
+  ACC -= mem[s->b];
+  PC = (ACC > 0) ? s->c : (PC + 6);
+  DISPATCH();
+f_load_store:
+  FUSED(5, 2);
+  ACC = mem[s->a];
+  WRITE(s->b, ACC, 4, 1);
+  PC += 4;
+  NEXT();
+#undef FUSED
+
+op_break:
+  if (vm->brk_skip != PC + 1)
+    LEAVE(vm_break_stop(vm, ACC, PC, STEPS() - 1));
+  // retomando do breakpoint: executa a instrução com o handler de verdade
+  vm->brk_skip = 0;
+  if (!isa_opcode(s->op))
+    goto op_bad;
+  if ((op_size(s->op) >= 2 && s->a >= MEM_SIZE) || (op_size(s->op) == 3 && s->b >= MEM_SIZE))
+    goto op_badarg;
+  goto *handlers[s->op];
+op_badarg:
+  LEAVE(vm_exit(vm, ACC, PC, STEPS(), "Erro: %s end", ISA[s->op].mnemonic));
+op_bad:
+  PROF(++prof->ops[0]);
+  LEAVE(vm_exit(vm, ACC, PC, STEPS(), "Opcode desconhecido %d em PC=%u", s->op, PC));
+pc_out:
+  FAIL("PC fora da memória");
+step_limit:
+  return vm_step_limit(vm, ACC, PC, steps);
+run_tail:
+  // o limite cai dentro desta sequência: contagem exata no motor de referência
+  vm->cpu.ACC = ACC;
+  vm->cpu.PC = PC;
+  vm->cpu.steps = steps;
+  if (RUNS)
+  {
+    int rc = run_switch(vm);
+    // o erro de limite (passos além de max_steps + 1) conta o passo que não executou
+    long long done = vm->cpu.steps - steps - (vm->cpu.steps > vm->cfg.max_steps + 1);
+    ++runs[PC];
+    runs_uncount(vm, PC, run_len[PC] - done);
+    return rc;
+  }
+  return run_switch(vm);
+
+#undef NEXT
+#undef STEPS
+#undef DISPATCH
+#undef WRITE
+#undef PROF
+#undef FAIL
+#undef LEAVE
+}
+
+static int run_threaded(Vm *vm)
+{
+  if (vm->prof)
+    return threaded_loop<true, false, false>(vm);
+  if (vm->verified)
+    return vm->runs ? threaded_loop<false, true, true>(vm) : threaded_loop<false, true, false>(vm);
+  return threaded_loop<false, false, false>(vm);
+}
+
+/*
+ * Motor JIT (x86-64): traduz blocos básicos da imagem para código nativo em
+ * um buffer mmap'd executável, um por Vm.
+ *
+ * Registradores durante o código nativo:
+ *   ebx = ACC          r12 = base de mem        r13 = codemap
+ *   r14 = JitState*    r15 = passos restantes   rbp = table
+ * O PC só é materializado (em eax) nas saídas para o C.
+ *
+ * Cada bloco começa descontando de r15 o seu número de instruções; se o
+ * orçamento não cobre o bloco inteiro, a execução volta ao motor de
+ * referência, que faz a contagem exata passo a passo. Saltos encadeiam via
+ * "jmp [rbp + alvo*8]": table[alvo] aponta para o bloco traduzido ou
+ * para um stub que devolve o controle ao C para traduzir o alvo.
+ *
+ * codemap[x] conta os blocos vivos que cobrem a palavra x. STORE/COPY
+ * consultam o mapa após a escrita e INPUT recebe a resposta do helper; se a
+ * palavra era código, o bloco sai para o C, que invalida os blocos
+ * afetados antes de continuar (retradução sob demanda).
+ *
+ * Um programa que reescreve o próprio código em um laço (operandos usados
+ * como ponteiros) faria isso a cada volta: sair, invalidar e traduzir de
+ * novo custa centenas de vezes uma instrução. smc[x] conta as invalidações
+ * causadas por escritas em x; a partir de JIT_SMC_LIMIT a palavra fica
+ * "fria": nenhum bloco passa a cobri-la, e a execução que chega a uma
+ * instrução fria segue no motor de referência por JIT_INTERP_SLICE passos
+ * antes de voltar aos blocos traduzidos.
+ */
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_AVAILABLE 1
+#else
+#define JIT_AVAILABLE 0
+#endif
+
+#if JIT_AVAILABLE
+#define JIT_BUFFER_SIZE (16u << 20)
+#define JIT_MAX_BLOCK 64        // instruções por bloco
+#define JIT_MAX_BLOCK_BYTES 8192 // folga mínima no buffer para traduzir um bloco
+#define JIT_MAX_STUBS (2 * JIT_MAX_BLOCK + 1) // DIV: zero e estouro
+#define JIT_SMC_LIMIT 4           // invalidações por palavra até ela ficar com o interpretador
+#define JIT_INTERP_SLICE 4096     // passos no motor de referência a cada chegada a código frio
+
+enum
+{
+  JIT_EXIT_MISS,    // eax = PC ainda não traduzido
+  JIT_EXIT_STOP,    // eax = PC do STOP
+  JIT_EXIT_BUDGET,  // eax = início do bloco que não coube no orçamento
+  JIT_EXIT_SMC,     // eax = próximo PC, arg = endereço escrito
+  JIT_EXIT_DIVZERO, // eax = PC do DIV
+  JIT_EXIT_DIVOVF,  // eax = PC do DIV: INT32_MIN / -1 (idiv geraria SIGFPE)
+  JIT_EXIT_INPUT,   // eax = próximo PC: INPUT sem valor na entrada
+  JIT_EXIT_WAIT_IN, // eax = próximo PC: INPUT/OUTPUT bloquearia (não executado)
+  JIT_EXIT_WAIT_OUT,
+  JIT_EXIT_HELPER   // só no stub: motivo devolvido pelo helper em eax
+};
+
+typedef struct
+{
+  int32_t acc;
+  uint32_t pc;
+  int64_t budget;
+  int32_t *mem;
+  uint8_t *codemap;
+  void **table;
+  uint32_t reason;
+  uint32_t arg;
+  Vm *vm;
+} JitState;
+
+typedef struct
+{
+  uint8_t *fixup; // rel32 a ser apontado para o stub
+  int kind;       // JIT_EXIT_BUDGET / JIT_EXIT_SMC / JIT_EXIT_DIV* / JIT_EXIT_HELPER
+  uint32_t pc;
+  uint32_t addr;
+  int32_t refund; // instruções do bloco não executadas
+} JitStub;
+
+struct Jit
+{
+  uint8_t *buf, *cur, *code_start;
+  uint8_t *exit, *miss;
+  uint32_t (*enter)(JitState *, const void *);
+  void *table[MEM_SIZE + 1];
+  uint8_t codemap[MEM_SIZE];
+  uint32_t block_end[MEM_SIZE]; // 0 = sem bloco começando aqui
+  uint8_t smc[MEM_SIZE];        // invalidações por escrita em cada palavra (até JIT_SMC_LIMIT)
+};
+
+static void e8(Jit *j, uint8_t b) { *j->cur++ = b; }
+static void e32(Jit *j, uint32_t v)
+{
+  memcpy(j->cur, &v, 4);
+  j->cur += 4;
+}
+static void e64(Jit *j, uint64_t v)
+{
+  memcpy(j->cur, &v, 8);
+  j->cur += 8;
+}
+static void patch_rel32(uint8_t *at, const uint8_t *target)
+{
+  int32_t rel = (int32_t)(target - (at + 4));
+  memcpy(at, &rel, 4);
+}
+static void emit_jmp(Jit *j, const uint8_t *target)
+{
+  e8(j, 0xE9);
+  e32(j, 0);
+  patch_rel32(j->cur - 4, target);
+}
+/* op r32, [r12 + a*4]: "opc" é o opcode (1 ou 2 bytes), "reg" o campo reg do ModRM */
+static void emit_mem_op(Jit *j, const uint8_t *opc, int len, int reg, uint32_t a)
+{
+  e8(j, 0x41);
+  for (int i = 0; i < len; ++i)
+    e8(j, opc[i]);
+  e8(j, 0x84 | (reg << 3)); // mod=10 rm=100 (SIB)
+  e8(j, 0x24);              // base = r12
+  e32(j, a * 4);
+}
+/* mov eax, pc ; jmp [rbp + pc*8] */
+static void emit_chain(Jit *j, uint32_t pc)
+{
+  e8(j, 0xB8);
+  e32(j, pc);
+  e8(j, 0xFF);
+  e8(j, 0xA5);
+  e32(j, pc * 8);
+}
+
+static void jit_flush(Jit *j)
+{
+  for (uint32_t i = 0; i <= MEM_SIZE; ++i)
+    j->table[i] = j->miss;
+  memset(j->codemap, 0, sizeof j->codemap);
+  memset(j->block_end, 0, sizeof j->block_end);
+  j->cur = j->code_start;
+}
+
+static Jit *jit_new(void)
+{
+  Jit *j = (Jit *)calloc(1, sizeof(Jit));
+  if (!j)
+    return NULL;
+  j->buf = (uint8_t *)mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (j->buf == MAP_FAILED)
+  {
+    free(j);
+    return NULL;
+  }
+  j->cur = j->buf;
+
+  // uint32_t enter(JitState *st, const void *alvo)
+  j->enter = (uint32_t(*)(JitState *, const void *))j->cur;
+  e8(j, 0x53);                  // push rbx
+  e8(j, 0x55);                  // push rbp
+  e8(j, 0x41), e8(j, 0x54);     // push r12
+  e8(j, 0x41), e8(j, 0x55);     // push r13
+  e8(j, 0x41), e8(j, 0x56);     // push r14
+  e8(j, 0x41), e8(j, 0x57);     // push r15
+  e8(j, 0x48), e8(j, 0x83), e8(j, 0xEC), e8(j, 0x08); // sub rsp, 8 (alinha chamadas)
+  e8(j, 0x49), e8(j, 0x89), e8(j, 0xFE);              // mov r14, rdi
+  e8(j, 0x41), e8(j, 0x8B), e8(j, 0x9E), e32(j, offsetof(JitState, acc));     // mov ebx, [r14+acc]
+  e8(j, 0x4D), e8(j, 0x8B), e8(j, 0xA6), e32(j, offsetof(JitState, mem));     // mov r12, [r14+mem]
+  e8(j, 0x4D), e8(j, 0x8B), e8(j, 0xAE), e32(j, offsetof(JitState, codemap)); // mov r13, [r14+codemap]
+  e8(j, 0x4D), e8(j, 0x8B), e8(j, 0xBE), e32(j, offsetof(JitState, budget));  // mov r15, [r14+budget]
+  e8(j, 0x49), e8(j, 0x8B), e8(j, 0xAE), e32(j, offsetof(JitState, table));   // mov rbp, [r14+table]
+  e8(j, 0xFF), e8(j, 0xE6);                                                   // jmp rsi
+
+  // saída comum: eax = pc, edx = motivo, ecx = argumento
+  j->exit = j->cur;
+  e8(j, 0x41), e8(j, 0x89), e8(j, 0x9E), e32(j, offsetof(JitState, acc));    // mov [r14+acc], ebx
+  e8(j, 0x4D), e8(j, 0x89), e8(j, 0xBE), e32(j, offsetof(JitState, budget)); // mov [r14+budget], r15
+  e8(j, 0x41), e8(j, 0x89), e8(j, 0x86), e32(j, offsetof(JitState, pc));     // mov [r14+pc], eax
+  e8(j, 0x41), e8(j, 0x89), e8(j, 0x96), e32(j, offsetof(JitState, reason)); // mov [r14+reason], edx
+  e8(j, 0x41), e8(j, 0x89), e8(j, 0x8E), e32(j, offsetof(JitState, arg));    // mov [r14+arg], ecx
+  e8(j, 0x48), e8(j, 0x83), e8(j, 0xC4), e8(j, 0x08); // add rsp, 8
+  e8(j, 0x41), e8(j, 0x5F);                           // pop r15
+  e8(j, 0x41), e8(j, 0x5E);                           // pop r14
+  e8(j, 0x41), e8(j, 0x5D);                           // pop r13
+  e8(j, 0x41), e8(j, 0x5C);                           // pop r12
+  e8(j, 0x5D);                                        // pop rbp
+  e8(j, 0x5B);                                        // pop rbx
+  e8(j, 0xC3);                                        // ret
+
+  // alvo ainda não traduzido: eax já contém o PC
+  j->miss = j->cur;
+  e8(j, 0xBA), e32(j, JIT_EXIT_MISS); // mov edx, MISS
+  emit_jmp(j, j->exit);
+
+  j->code_start = j->cur;
+  jit_flush(j);
+  return j;
+}
+
+static void jit_free(Jit *j)
+{
+  if (!j)
+    return;
+  munmap(j->buf, JIT_BUFFER_SIZE);
+  free(j);
+}
+
+/*
+ * 0 se leu; JIT_EXIT_SMC se a palavra escrita é código; JIT_EXIT_INPUT se a
+ * entrada acabou; JIT_EXIT_WAIT_IN se ela ainda não chegou. budget é r15 (o
+ * bloco inteiro já descontado) e rest as instruções do bloco depois deste
+ * INPUT.
+ */
+static int jit_input(JitState *st, uint32_t a, int64_t budget, uint32_t rest)
+{
+  long long v;
+  int got = io_read_int(&st->vm->io, st->vm->limit + 1 - budget - rest, &v);
+  if (got <= 0)
+    return got < 0 ? JIT_EXIT_WAIT_IN : JIT_EXIT_INPUT;
+  st->mem[a] = (int32_t)v;
+  return st->codemap[a] ? JIT_EXIT_SMC : 0;
+}
+
+/* 0 se escreveu; JIT_EXIT_WAIT_OUT se a saída está cheia. */
+static int jit_output(JitState *st, int32_t v)
+{
+  return io_write_int(&st->vm->io, v) < 0 ? JIT_EXIT_WAIT_OUT : 0;
+}
+
+/* 1 se alguma palavra da instrução em pc (< MEM_SIZE) já foi reescrita vezes demais. */
+static int jit_cold(const Jit *j, const int32_t *mem, uint32_t pc)
+{
+  int size = op_size(mem[pc]);
+  for (int k = 0; k < size && pc + k < MEM_SIZE; ++k)
+    if (j->smc[pc + k] >= JIT_SMC_LIMIT)
+      return 1;
+  return 0;
+}
+
+/* Devolve 0 se a instrução em pc não pode ser traduzida (erro em execução). */
+static int jit_translatable(const int32_t *mem, uint32_t pc)
+{
+  if (pc >= MEM_SIZE)
+    return 0;
+  int32_t op = mem[pc];
+  if (!isa_opcode(op))
+    return 0;
+  int size = op_size(op);
+  if (pc + size > MEM_SIZE)
+    return 0;
+  for (int k = 1; k < size; ++k)
+    if ((uint32_t)mem[pc + k] >= MEM_SIZE)
+      return 0;
+  return 1;
+}
+
+static int jit_translate(Jit *j, const int32_t *mem, int verified, uint32_t start)
+{
+  if (!jit_translatable(mem, start))
+    return 0;
+  if ((size_t)(j->buf + JIT_BUFFER_SIZE - j->cur) < JIT_MAX_BLOCK_BYTES)
+    jit_flush(j);
+
+  static const uint8_t MOV_LOAD[] = {0x8B}, ADD_OP[] = {0x03}, SUB_OP[] = {0x2B},
+                       IMUL_OP[] = {0x0F, 0xAF}, MOV_STORE[] = {0x89};
+  JitStub stubs[JIT_MAX_STUBS];
+  int nstubs = 0;
+  uint8_t *rest_at[JIT_MAX_BLOCK]; // imm32 de cada INPUT: instruções depois dele no bloco
+  int rest_count[JIT_MAX_BLOCK];
+  int nrest = 0;
+  uint8_t *entry = j->cur;
+
+  // sub r15, L ; jl stub_orçamento (L é preenchido ao final)
+  e8(j, 0x49), e8(j, 0x81), e8(j, 0xEF);
+  uint8_t *len_at = j->cur;
+  e32(j, 0);
+  e8(j, 0x0F), e8(j, 0x8C);
+  stubs[nstubs++] = (JitStub){j->cur, JIT_EXIT_BUDGET, start, 0, 0};
+  e32(j, 0);
+
+  uint32_t pc = start;
+  int count = 0;
+  int ended = 0;
+  // pendências de SMC/DIV guardam o índice da instrução; refund é ajustado no final
+  while (!ended)
+  {
+    if (count == JIT_MAX_BLOCK || !jit_translatable(mem, pc) || jit_cold(j, mem, pc))
+    {
+      emit_chain(j, pc);
+      break;
+    }
+    int32_t op = mem[pc];
+    uint32_t next = pc + op_size(op);
+    uint32_t a = next > pc + 1 ? (uint32_t)mem[pc + 1] : 0;
+    ++count;
+    switch (op)
+    {
+    case 1:
+      emit_mem_op(j, ADD_OP, 1, 3, a);
+      break;
+    case 2:
+      emit_mem_op(j, SUB_OP, 1, 3, a);
+      break;
+    case 3:
+      emit_mem_op(j, IMUL_OP, 2, 3, a);
+      break;
+    case 4:
+      emit_mem_op(j, MOV_LOAD, 1, 1, a); // mov ecx, [mem+a]
+      e8(j, 0x85), e8(j, 0xC9);          // test ecx, ecx
+      e8(j, 0x0F), e8(j, 0x84);          // jz stub
+      stubs[nstubs++] = (JitStub){j->cur, JIT_EXIT_DIVZERO, pc, 0, count};
+      e32(j, 0);
+      e8(j, 0x83), e8(j, 0xF9), e8(j, 0xFF);        // cmp ecx, -1
+      e8(j, 0x75), e8(j, 12);                       // jne idiv
+      e8(j, 0x81), e8(j, 0xFB), e32(j, 0x80000000); // cmp ebx, INT32_MIN
+      e8(j, 0x0F), e8(j, 0x84);                     // je stub
+      stubs[nstubs++] = (JitStub){j->cur, JIT_EXIT_DIVOVF, pc, 0, count};
+      e32(j, 0);
+      e8(j, 0x89), e8(j, 0xD8); // mov eax, ebx
+      e8(j, 0x99);              // cdq
+      e8(j, 0xF7), e8(j, 0xF9); // idiv ecx
+      e8(j, 0x89), e8(j, 0xC3); // mov ebx, eax
+      break;
+    case 5:
+      emit_chain(j, a);
+      ended = 1;
+      break;
+    case 6:
+    case 7:
+    case 8:
+      e8(j, 0x85), e8(j, 0xDB);                       // test ebx, ebx
+      e8(j, op == 6 ? 0x78 : op == 7 ? 0x7F : 0x74); // js / jg / jz
+      e8(j, 11);                                      // pula o encadeamento "não tomado"
+      emit_chain(j, next);
+      emit_chain(j, a);
+      ended = 1;
+      break;
+    case 9:
+    {
+      uint32_t b = (uint32_t)mem[pc + 2];
+      emit_mem_op(j, MOV_LOAD, 1, 0, a);  // mov eax, [mem+a]
+      emit_mem_op(j, MOV_STORE, 1, 0, b); // mov [mem+b], eax
+      a = b;
+    }
+      // fallthrough: checagem de escrita em código sobre b
+    case 11:
+      if (op == 11)
+        emit_mem_op(j, MOV_STORE, 1, 3, a);
+      if (verified)
+        break;
+      e8(j, 0x41), e8(j, 0x80), e8(j, 0xBD), e32(j, a), e8(j, 0x00); // cmp byte [r13+a], 0
+      e8(j, 0x0F), e8(j, 0x85);                                      // jne stub
+      stubs[nstubs++] = (JitStub){j->cur, JIT_EXIT_SMC, next, a, count};
+      e32(j, 0);
+      break;
+    case 10:
+      emit_mem_op(j, MOV_LOAD, 1, 3, a);
+      break;
+    case 12:
+      // o helper sempre pode falhar por fim da entrada, mesmo com a prova
+      e8(j, 0x4C), e8(j, 0x89), e8(j, 0xF7); // mov rdi, r14
+      e8(j, 0xBE), e32(j, a);                // mov esi, a
+      e8(j, 0x4C), e8(j, 0x89), e8(j, 0xFA); // mov rdx, r15
+      e8(j, 0xB9);                           // mov ecx, rest (preenchido ao final)
+      rest_at[nrest] = j->cur;
+      rest_count[nrest++] = count;
+      e32(j, 0);
+      e8(j, 0x48), e8(j, 0xB8), e64(j, (uint64_t)(uintptr_t)&jit_input);
+      e8(j, 0xFF), e8(j, 0xD0);              // call rax
+      e8(j, 0x85), e8(j, 0xC0);              // test eax, eax
+      e8(j, 0x0F), e8(j, 0x85);              // jnz stub
+      stubs[nstubs++] = (JitStub){j->cur, JIT_EXIT_HELPER, next, a, count};
+      e32(j, 0);
+      break;
+    case 13:
+      e8(j, 0x4C), e8(j, 0x89), e8(j, 0xF7); // mov rdi, r14
+      emit_mem_op(j, MOV_LOAD, 1, 6, a);     // mov esi, [mem+a]
+      e8(j, 0x48), e8(j, 0xB8), e64(j, (uint64_t)(uintptr_t)&jit_output);
+      e8(j, 0xFF), e8(j, 0xD0); // call rax
+      e8(j, 0x85), e8(j, 0xC0); // test eax, eax
+      e8(j, 0x0F), e8(j, 0x85); // jnz stub
+      stubs[nstubs++] = (JitStub){j->cur, JIT_EXIT_HELPER, next, a, count};
+      e32(j, 0);
+      break;
+    case 14:
+      e8(j, 0xB8), e32(j, pc);            // mov eax, pc
+      e8(j, 0xBA), e32(j, JIT_EXIT_STOP); // mov edx, STOP
+      emit_jmp(j, j->exit);
+      ended = 1;
+      break;
+    }
+    pc = next;
+  }
+  memcpy(len_at, &count, 4);
+  for (int i = 0; i < nrest; ++i)
+  {
+    int32_t rest = count - rest_count[i];
+    memcpy(rest_at[i], &rest, 4);
+  }
+
+  for (int i = 0; i < nstubs; ++i)
+  {
+    JitStub *st = &stubs[i];
+    patch_rel32(st->fixup, j->cur);
+    int32_t refund = st->kind == JIT_EXIT_BUDGET ? count : count - st->refund;
+    if (refund)
+    {
+      e8(j, 0x49), e8(j, 0x81), e8(j, 0xC7); // add r15, refund
+      e32(j, refund);
+    }
+    if (st->kind == JIT_EXIT_HELPER)
+      e8(j, 0x89), e8(j, 0xC2); // mov edx, eax
+    else
+      e8(j, 0xBA), e32(j, st->kind); // mov edx, motivo
+    e8(j, 0xB8), e32(j, st->pc);   // mov eax, pc
+    e8(j, 0xB9), e32(j, st->addr); // mov ecx, addr
+    emit_jmp(j, j->exit);
+  }
+
+  j->table[start] = entry;
+  j->block_end[start] = pc;
+  for (uint32_t x = start; x < pc && x < MEM_SIZE; ++x)
+    ++j->codemap[x];
+  return 1;
+}
+
+/* Escrita na palavra x, que é código: invalida todos os blocos vivos que a cobrem. */
+static void jit_invalidate(Jit *j, uint32_t x)
+{
+  if (j->smc[x] < JIT_SMC_LIMIT)
+    ++j->smc[x];
+  uint32_t lo = x >= 3 * JIT_MAX_BLOCK ? x - 3 * JIT_MAX_BLOCK + 1 : 0;
+  for (uint32_t s = lo; s <= x; ++s)
+  {
+    uint32_t end = j->block_end[s];
+    if (end > x)
+    {
+      j->table[s] = j->miss;
+      j->block_end[s] = 0;
+      for (uint32_t y = s; y < end && y < MEM_SIZE; ++y)
+        --j->codemap[y];
+    }
+  }
+}
+
+static void jit_code_write(Vm *vm, uint32_t x)
+{
+  if (vm->jit->codemap[x])
+    jit_invalidate(vm->jit, x);
+}
+
+/*
+ * Código frio em st->pc: até JIT_INTERP_SLICE passos no motor de referência,
+ * que invalida os blocos em que escrever. -1 para voltar aos blocos, com st
+ * atualizado; senão o resultado da execução (STOP, erro, pausa ou espera).
+ */
+static int jit_interpret(Vm *vm, JitState *st, long long max_steps)
+{
+  vm->cpu.ACC = st->acc;
+  vm->cpu.PC = st->pc;
+  vm->cpu.steps = max_steps + 1 - st->budget;
+  int sliced = vm->cpu.steps + JIT_INTERP_SLICE < max_steps;
+  if (sliced)
+    vm->limit = vm->cpu.steps + JIT_INTERP_SLICE;
+  int rc = switch_loop<true, false, true>(vm);
+  vm->limit = max_steps;
+  if (rc != VM_PAUSED || !sliced)
+    return rc;
+  st->acc = vm->cpu.ACC;
+  st->pc = vm->cpu.PC;
+  st->budget = max_steps + 1 - vm->cpu.steps;
+  return -1;
+}
+
+static int run_jit(Vm *vm)
+{
+  if (!vm->jit && !(vm->jit = jit_new()))
+  {
+    fprintf(stderr, "Aviso: mmap executável indisponível, usando --engine=threaded\n");
+    return run_threaded(vm);
+  }
+  Jit *j = vm->jit;
+  // blocos de outra execução não valem; numa imagem não verificada, o motor
+  // de referência pode ter escrito em código desde a última pausa
+  if (!vm->jit_valid || !vm->verified)
+    jit_flush(j);
+  if (!vm->jit_valid)
+    memset(j->smc, 0, sizeof j->smc); // as palavras frias valem só para uma execução
+  vm->jit_valid = 1;
+
+  const long long max_steps = vm->limit;
+  JitState st;
+  st.acc = vm->cpu.ACC;
+  st.pc = vm->cpu.PC;
+  st.budget = max_steps + 1 - vm->cpu.steps;
+  st.mem = vm->mem;
+  st.codemap = j->codemap;
+  st.table = j->table;
+  st.vm = vm;
+
+  while (1)
+  {
+    if (j->table[st.pc] == j->miss && st.pc < MEM_SIZE && jit_cold(j, vm->mem, st.pc))
+    {
+      int rc = jit_interpret(vm, &st, max_steps);
+      if (rc >= 0)
+        return rc;
+      continue;
+    }
+    if (j->table[st.pc] == j->miss && !jit_translate(j, vm->mem, vm->verified, st.pc))
+      break; // instrução que falha em execução: o motor de referência reporta o erro
+    j->enter(&st, j->table[st.pc]);
+    long long steps = max_steps + 1 - st.budget;
+    if (st.reason == JIT_EXIT_STOP)
+      return vm_exit(vm, st.acc, st.pc, steps, NULL);
+    if (st.reason == JIT_EXIT_SMC)
+      jit_invalidate(j, st.arg);
+    else if (st.reason == JIT_EXIT_DIVZERO)
+      return vm_exit(vm, st.acc, st.pc, steps, "Erro: DIV zero");
+    else if (st.reason == JIT_EXIT_DIVOVF)
+      return vm_exit(vm, st.acc, st.pc, steps, "Erro: DIV overflow");
+    else if (st.reason == JIT_EXIT_INPUT)
+      return vm_exit(vm, st.acc, st.pc - 2, steps, "Erro: INPUT falha");
+    else if (st.reason == JIT_EXIT_WAIT_IN || st.reason == JIT_EXIT_WAIT_OUT)
+      return vm_wait(vm, st.acc, st.pc - 2, steps - 1,
+                     st.reason == JIT_EXIT_WAIT_IN ? VM_WAIT_INPUT : VM_WAIT_OUTPUT);
+    else if (st.reason == JIT_EXIT_BUDGET)
+      break;
+  }
+  vm->cpu.ACC = st.acc;
+  vm->cpu.PC = st.pc;
+  vm->cpu.steps = max_steps + 1 - st.budget;
+  return run_switch(vm);
+}
+#else
+struct Jit
+{
+  int unused;
+};
+
+static void jit_free(Jit *) {}
+
+static void jit_code_write(Vm *, uint32_t) {}
+
+static int run_jit(Vm *vm)
+{
+  fprintf(stderr, "Aviso: JIT disponível apenas em x86-64, usando --engine=threaded\n");
+  return run_threaded(vm);
+}
+#endif
+
+int vm_run(Vm *vm, long long budget)
+{
+  const VmConfig *cfg = &vm->cfg;
+  // limit = último passo antes da pausa; max_steps é o limite de verdade
+  if (budget > 0 && budget <= cfg->max_steps - vm->cpu.steps)
+    vm->limit = vm->cpu.steps + budget - 1;
+  else
+    vm->limit = cfg->max_steps;
+  if (vm->brk_skip != vm->cpu.PC + 1)
+    vm->brk_skip = 0; // o PC mudou desde a parada
+  // só o motor threaded numa imagem verificada conta as sequências
+  if (vm->runs && (vm->prof || !vm->verified || cfg->engine == ENGINE_SWITCH || cfg->trace || vm->tracer ||
+                   (cfg->engine == ENGINE_JIT && !vm->n_brk && !vm->n_watch)))
+    vm->runs_ok = 0;
+  if (vm->prof)
+    return run_threaded(vm); // só o motor threaded é instrumentado
+  if (cfg->engine == ENGINE_SWITCH || cfg->trace || vm->tracer)
+    return run_switch(vm);
+  if (cfg->engine == ENGINE_JIT && !vm->n_brk && !vm->n_watch)
+    return run_jit(vm);
+  return run_threaded(vm);
+}
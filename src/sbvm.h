@@ -0,0 +1,396 @@
+#ifndef SBVM_H
+#define SBVM_H
+
+/*
+ * libsbvm: a máquina hipotética (ver sbvm.cpp) como biblioteca, para ser
+ * embutida em outros programas. O simulador é só um driver sobre ela.
+ *
+ * Uso típico, rodando o mesmo programa muitas vezes no mesmo processo:
+ *
+ *   const char *why;
+ *   Image *img = image_new();
+ *   if (!img || !image_load(img, "prog.o2", &why))
+ *     ...;                        // why: motivo, ou NULL se não abriu
+ *   VmConfig cfg;
+ *   vm_config_default(&cfg);
+ *   Vm *vm = vm_new(&cfg);
+ *   vm_set_io(vm, ler, escrever, ctx);
+ *   vm_load(vm, img);
+ *   for (...)
+ *   {
+ *     vm_reset(vm);               // só as páginas que o programa escreve
+ *     int rc = vm_run(vm, 0);     // 0 = STOP, 1 = erro em vm->err
+ *   }
+ *   vm_free(vm);
+ *   image_free(img);
+ *
+ * Uma Image pode ser compartilhada, só para leitura, entre Vms de threads
+ * diferentes; cada Vm só pode ser usada por uma thread de cada vez.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "isa.h"
+
+/*
+ * Palavras no espaço de endereçamento. A memória de cada Vm é reservada
+ * com mmap e só ocupa as páginas tocadas, então um espaço maior custa só
+ * endereços virtuais: compile tudo com -DMEM_SIZE=N para aumentá-lo (o
+ * trace binário guarda PCs de 16 bits e fica indisponível acima de 65536).
+ */
+#ifndef MEM_SIZE
+#define MEM_SIZE 65536
+#endif
+#define VM_PAGE_WORDS 256
+#define VM_PAGES (MEM_SIZE / VM_PAGE_WORDS)
+
+/*
+ * vm_run devolve 0 (STOP), 1 (erro em vm->err), VM_PAUSED (orçamento
+ * esgotado), VM_BREAK (breakpoint em cpu.PC, instrução ainda não executada)
+ * ou VM_WATCH (escrita no endereço vigiado vm->watch_hit, instrução já
+ * executada). VM_WAIT_INPUT e VM_WAIT_OUTPUT: o INPUT/OUTPUT em cpu.PC
+ * bloquearia (ver Io), não foi executado e roda de novo ao retomar.
+ */
+#define VM_PAUSED 2
+#define VM_BREAK 3
+#define VM_WATCH 4
+#define VM_WAIT_INPUT 5
+#define VM_WAIT_OUTPUT 6
+
+typedef enum
+{
+  ENGINE_THREADED,
+  ENGINE_SWITCH,
+  ENGINE_JIT
+} Engine;
+
+typedef struct
+{
+  Engine engine;
+  long long max_steps; // passar daqui é erro ("limite de passos excedido")
+  int fusion;          // superinstruções no motor threaded
+  int verify;          // usa a prova do verificador para o caminho sem checagens
+  int trace;           // uma linha por passo em stderr (motor switch)
+} VmConfig;
+
+/* Nomes, tamanhos e classes dos opcodes vêm da tabela de isa.h; os motores
+ * implementam a semântica de cada um à mão. */
+static_assert(ISA_MAX_OPCODE == 14, "os motores implementam os opcodes 1..14");
+
+static inline int op_size(int32_t op)
+{
+  return isa_opcode(op) ? ISA[op].size : 2; // desconhecido: 2, como sempre
+}
+
+/* Estado arquitetural visível: usado para retomar a execução em outro motor. */
+typedef struct
+{
+  int32_t ACC;
+  uint32_t PC;
+  long long steps;
+} Cpu;
+
+/*
+ * Instruções de uma sequência linear (Image::run_len). Todas as que não
+ * desviam têm pelo menos 2 palavras, então uma sequência tem no máximo
+ * MEM_SIZE / 2 + 1 instruções: 16 bits bastam até MEM_SIZE = 131068.
+ */
+#if MEM_SIZE / 2 + 1 <= 0xFFFF
+typedef uint16_t RunLen;
+#else
+typedef uint32_t RunLen;
+#endif
+static_assert((unsigned long long)MEM_SIZE / 2 + 1 <= (RunLen)~(RunLen)0, "RunLen estreito demais para MEM_SIZE");
+
+/* Resultado do verificador estático (ver verify_image em sbvm.cpp). */
+#define MAX_REASONS 16
+
+typedef struct
+{
+  int ok;
+  uint32_t n_instr;   // instruções alcançáveis
+  uint32_t n_code;    // palavras de código
+  int n_reasons;      // total de problemas encontrados
+  char reasons[MAX_REASONS][96];
+} Proof;
+
+/*
+ * Imagem carregada e verificada; só leitura durante a execução. As palavras
+ * ficam em um arquivo anônimo (memfd) que cada Vm mapeia com cópia na
+ * escrita: páginas que o programa não escreve são as mesmas, na memória
+ * física, para todas as VMs da imagem.
+ */
+typedef struct
+{
+  int32_t *words;               // conteúdo inicial da memória ([n, MEM_SIZE) zerado)
+  int fd;                       // memfd com words; -1: vm_load copia as palavras
+  size_t n;                     // palavras carregadas
+  uint32_t entry;               // PC inicial
+  uint32_t code_end;            // fronteira código/dados declarada (.o2b); 0 = desconhecida
+  Proof proof;
+  uint8_t leader[MEM_SIZE + 1]; // início de bloco básico
+  RunLen run_len[MEM_SIZE + 1]; // instruções de pc até o próximo desvio/STOP, inclusive
+  uint8_t write_page[VM_PAGES]; // páginas que alguma execução pode escrever
+} Image;
+
+/*
+ * E/S do programa simulado. Com callbacks (vm_set_io), INPUT e OUTPUT
+ * chamam as funções do hospedeiro. Sem eles, OUTPUT grava em um buffer
+ * grande, esvaziado no STOP, em erro ou quando enche; antes de bloquear
+ * lendo a entrada o buffer também é esvaziado, para que prompts apareçam.
+ * INPUT usa um leitor de inteiros próprio sobre um buffer de leitura ou
+ * sobre um arquivo mapeado com mmap. interactive esvazia a saída a cada
+ * linha. Com out_fd < 0 a saída é acumulada em memória (cap).
+ *
+ * Descritores em O_NONBLOCK (sockets, pipes) nunca bloqueiam a execução:
+ * um INPUT sem número completo na entrada e um OUTPUT com o buffer cheio
+ * fazem vm_run devolver VM_WAIT_INPUT/VM_WAIT_OUTPUT, e o que o descritor
+ * não aceitou fica no buffer para o próximo io_flush. Basta chamar vm_run
+ * de novo quando ele estiver pronto (vm_sched_* faz isso com epoll).
+ */
+#define IO_OUT_SIZE (1 << 16)
+#define IO_IN_SIZE (1 << 16)
+
+/*
+ * step é o número (a partir de 1) do passo do INPUT, o mesmo em todos os
+ * motores. Devolve 0 quando não há mais valores (o INPUT falha) e -1 para
+ * suspender a execução (VM_WAIT_INPUT; o INPUT pede o valor de novo).
+ */
+typedef int (*VmInputFn)(void *ctx, long long step, long long *value);
+typedef void (*VmOutputFn)(void *ctx, int32_t value);
+
+typedef struct
+{
+  char out[IO_OUT_SIZE];
+  size_t out_len;
+  int out_fd;      // -1: captura em cap
+  int interactive;
+  char *cap;       // saída capturada
+  size_t cap_len, cap_size;
+  const char *in, *in_end; // janela de entrada ainda não consumida
+  const char *in_start;    // início da janela atual
+  uint64_t in_base;        // bytes de entrada anteriores à janela atual
+  int in_fd;               // -1: entrada mapeada ou esgotada, sem recarga
+  void *in_map;            // arquivo de entrada mapeado (desfeito em io_reset)
+  size_t in_map_len;
+  VmInputFn in_fn;         // não nulos: E/S pelo hospedeiro
+  VmOutputFn out_fn;
+  void *fn_ctx;
+  uint64_t n_in, n_out;    // INPUTs e OUTPUTs executados desde io_reset
+  char in_buf[IO_IN_SIZE];
+} Io;
+
+void io_flush(Io *io);
+/* Bytes de saída no buffer que o descritor ainda não aceitou. */
+static inline size_t io_pending(const Io *io) { return io->out_fd < 0 ? 0 : io->out_len; }
+/* Prepara a E/S de uma nova execução; in_fd < 0 = entrada vazia. Mantém os callbacks. */
+void io_reset(Io *io, int out_fd, int in_fd, int interactive);
+int io_open_input(Io *io, const char *path);
+/*
+ * A E/S padrão, sem passar pelos callbacks: para callbacks que só observam
+ * o fluxo (gravação/replay) e repassam os valores. -1: o descritor
+ * O_NONBLOCK não tem o número inteiro ainda / não aceita mais saída (nada
+ * foi consumido nem escrito).
+ */
+int io_next_int(Io *io, long long *value);
+int io_put_int(Io *io, int32_t value);
+/* Bytes da entrada já consumidos pelo programa. */
+uint64_t io_offset(const Io *io);
+/* Descarta n bytes da entrada (retomada de um snapshot); 0 se ela acabar antes. */
+int io_skip(Io *io, uint64_t n);
+
+/*
+ * Contadores do perfil (vm_enable_profile). Acessos de dados não incluem a
+ * busca da instrução; count tem uma posição extra para o PC fora da memória.
+ */
+typedef struct
+{
+  uint64_t count[MEM_SIZE + 1];     // execuções por PC
+  uint64_t taken[MEM_SIZE];         // desvios tomados (JMP/JMPN/JMPP/JMPZ)
+  uint64_t reads[MEM_SIZE];         // leituras de dados por endereço
+  uint64_t writes[MEM_SIZE];        // escritas de dados por endereço
+  uint64_t ops[ISA_MAX_OPCODE + 1]; // histograma de opcodes (0 = desconhecido)
+} Profile;
+
+#define VM_FUSIONS 6 // sequências fundidas pelo motor threaded
+
+typedef struct Slot Slot;
+typedef struct Tracer Tracer;
+typedef struct Jit Jit;
+
+/*
+ * Estado de uma execução. Os motores leem e escrevem só aqui e na imagem
+ * (só leitura), então VMs diferentes podem rodar em threads diferentes.
+ * Um erro em execução não encerra o processo: o motor grava a mensagem em
+ * err, o estado final em cpu e devolve 1.
+ *
+ * mem e code são mapeamentos privados: a memória vem da imagem e os
+ * registros de um modelo "não decodificado" compartilhado, e só as páginas
+ * escritas viram cópias da Vm. Uma Vm parada ocupa poucos KB.
+ */
+typedef struct
+{
+  int32_t *mem;           // MEM_SIZE palavras
+  Cpu cpu;                // estado inicial antes de vm_run, final depois
+  long long limit;        // pausa ao passar deste passo (max_steps = limite real)
+  const Image *img;
+  VmConfig cfg;
+  int verified;           // prova aceita: caminho sem checagens
+  Io io;
+  char err[96];           // mensagem do erro em execução, sem '\n'
+  Slot *code;             // motor threaded: MEM_SIZE + 1 registros
+  uint8_t *covered;
+  uint8_t *fused_at;      // superinstruções já contadas em cada PC (um bit por sequência)
+  uint8_t *rewrites;      // invalidações causadas por escritas em cada palavra
+  long long fusion_sites[VM_FUSIONS], fusion_hits[VM_FUSIONS]; // PCs distintos, execuções
+  Jit *jit;               // blocos traduzidos, criado na primeira execução JIT
+  Profile *prof;          // não nulo: execução instrumentada
+  uint64_t *runs;         // não nulo: entradas em sequência linear por PC (vm_enable_op_counts)
+  int runs_ok;            // runs cobre todos os passos desde vm_load
+  Tracer *tracer;         // não nulo: trace binário
+  const void *decoded;    // dono dos registros em code (rótulo decode); NULL = inválidos
+  int jit_valid;          // blocos traduzidos valem para a memória atual
+  uint8_t *brk;           // breakpoints por PC (vm_break); NULL = nenhum ainda
+  uint8_t *watch;         // watchpoints por endereço (vm_watch)
+  int n_brk, n_watch;
+  uint32_t brk_skip;      // PC + 1 do breakpoint onde parou (não para de novo ao retomar); 0 = nenhum
+  uint32_t watch_hit;     // endereço escrito na parada VM_WATCH
+} Vm;
+
+Image *image_new(void);
+void image_free(Image *img);
+/*
+ * Carrega um .o2 ou .o2b e roda o verificador. Em falha devolve 0 e, em
+ * *why, o motivo (NULL se o arquivo não abre).
+ */
+int image_load(Image *img, const char *path, const char **why);
+/* Mesmo que image_load, a partir de palavras já em memória (entrada em 0). */
+int image_set_words(Image *img, const int32_t *words, size_t n, const char **why);
+
+/*
+ * Traduz uma imagem verificada para um programa C autônomo (sbvm_aot.cpp)
+ * com o limite de passos max_steps. 0 se a imagem não tem a prova, se falta
+ * memória ou se a escrita falha. source só aparece no comentário inicial.
+ */
+int image_emit_c(const Image *img, FILE *out, const char *source, long long max_steps);
+
+void vm_config_default(VmConfig *cfg);
+/* NULL se falta memória. */
+Vm *vm_new(const VmConfig *cfg);
+void vm_free(Vm *vm);
+/* E/S pelo hospedeiro; NULL volta ao buffer/descritores de vm->io. */
+void vm_set_io(Vm *vm, VmInputFn in, VmOutputFn out, void *ctx);
+/* Copia a imagem inteira para a memória e zera o estado; E/S fica por conta de quem chama. */
+void vm_load(Vm *vm, const Image *img);
+/*
+ * Volta ao estado logo após vm_load da mesma imagem. Numa imagem
+ * verificada só as páginas que o programa pode escrever são restauradas e
+ * os registros decodificados e blocos traduzidos continuam valendo; nas
+ * outras, equivale a vm_load. Quem alterou vm->mem por fora deve usar vm_load.
+ */
+void vm_reset(Vm *vm);
+/*
+ * Executa a partir de vm->cpu com o motor de vm->cfg. budget > 0 pausa
+ * (VM_PAUSED) depois de budget instruções; budget = 0 roda até o STOP, um
+ * erro ou o limite de cfg.max_steps.
+ */
+int vm_run(Vm *vm, long long budget);
+/*
+ * Breakpoint em pc (on = 1) ou remove (on = 0). Não há checagem por passo:
+ * o registro decodificado de pc ganha um handler de parada (e nenhuma
+ * superinstrução passa por cima dele). Retomar de um breakpoint executa a
+ * instrução antes de parar de novo. 0 se pc está fora da memória ou falta
+ * memória. Breakpoints e watchpoints sobrevivem a vm_load.
+ */
+int vm_break(Vm *vm, uint32_t pc, int on);
+/*
+ * Watchpoint de escrita em addr: STORE, COPY e INPUT (só eles consultam o
+ * mapa) param com VM_WATCH logo depois de escrever. Com breakpoints ou
+ * watchpoints, o motor jit cede a vez ao threaded.
+ */
+int vm_watch(Vm *vm, uint32_t addr, int on);
+/* Liga os contadores de vm->prof (motor threaded instrumentado); 0 se falta memória. */
+int vm_enable_profile(Vm *vm);
+/*
+ * Histograma exato de opcodes sem instrumentar cada instrução: o motor
+ * threaded, numa imagem verificada, soma 1 por entrada em sequência linear
+ * (onde já cobra os passos de run_len) e vm_op_counts expande essas
+ * entradas pelos opcodes de cada sequência. 0 se falta memória.
+ */
+int vm_enable_op_counts(Vm *vm);
+/*
+ * Execuções por opcode desde vm_load em ops (ops pode ser NULL). 0 se a
+ * contagem não está ligada ou se algum passo rodou em outro motor (switch,
+ * jit, perfil, imagem não verificada): aí só resta amostrar.
+ */
+int vm_op_counts(const Vm *vm, uint64_t ops[ISA_MAX_OPCODE + 1]);
+/*
+ * Trace binário (trace_format.h) em path: last > 0 guarda só os últimos
+ * last registros; só PCs em [lo, hi], um passo a cada every. 0 se o
+ * arquivo não pode ser criado ou se os PCs de MEM_SIZE não cabem nos 16
+ * bits do registro (SBT_MAX_PC).
+ */
+int vm_trace_open(Vm *vm, const char *path, long long last, uint32_t lo, uint32_t hi, long long every);
+/* Grava o que falta do trace e fecha o arquivo. */
+void vm_trace_close(Vm *vm);
+void vm_print_fusion_stats(const Vm *vm, FILE *out);
+
+/*
+ * Motor em lanes (sbvm_lanes.cpp): uma imagem verificada executada sobre
+ * as entradas de VM_LANES jobs de uma vez, ACC e memória em estrutura de
+ * vetores. Compile tudo com -DVM_LANES=16 para lanes de AVX-512.
+ */
+#ifndef VM_LANES
+#define VM_LANES 8
+#endif
+typedef struct VmLanes VmLanes;
+/* Próximo job: prepara io (entrada, saída capturada) e devolve um id >= 0, ou -1 se acabou. */
+typedef long (*LaneNextFn)(void *ctx, Io *io);
+/* Job terminado: status e steps como em vm_run/vm->cpu, err != NULL se status = 1. */
+typedef void (*LaneDoneFn)(void *ctx, long job, int status, long long steps, const char *err, Io *io);
+/* NULL se falta memória. */
+VmLanes *vm_lanes_new(const VmConfig *cfg);
+void vm_lanes_free(VmLanes *l);
+/*
+ * Roda jobs de next até ele devolver -1; cada um termina em done, não
+ * necessariamente na ordem. Lanes que divergem demais, chegam ao limite de
+ * passos ou ficam sozinhos terminam no motor escalar de vm (que fica com a
+ * imagem carregada). 0, sem chamar next, se a imagem não tem a prova.
+ */
+int vm_lanes_run(VmLanes *l, const Image *img, Vm *vm, LaneNextFn next, LaneDoneFn done, void *ctx);
+/* Instruções despachadas para grupos, executadas somando os lanes e lanes passados ao motor escalar. */
+void vm_lanes_stats(const VmLanes *l, long long *group_steps, long long *lane_steps, long long *peeled);
+
+/*
+ * Escalonador (sbvm_sched.cpp): muitas sessões interativas em uma thread.
+ * Cada sessão é uma Vm com a E/S em descritores (sockets, pipes) que passam
+ * a O_NONBLOCK. As sessões prontas rodam fatias de slice instruções. Uma
+ * que espera entrada ou saída (VM_WAIT_*) sai da fila até o epoll avisar
+ * que o descritor está pronto. Todo o estado já está na Vm, então uma
+ * sessão parada não ocupa thread nem pilha.
+ */
+typedef struct VmSched VmSched;
+/* Sessão terminada (status de vm_run) e saída entregue; vm e descritores voltam para quem chamou. */
+typedef void (*VmSessionDoneFn)(void *ctx, Vm *vm, int status, void *user);
+/* Descritor do hospedeiro (vm_sched_watch) legível. */
+typedef void (*VmHostFn)(void *ctx, int fd);
+/* NULL se falta memória ou epoll. */
+VmSched *vm_sched_new(long long slice, VmSessionDoneFn done, void *ctx);
+/* Não fecha descritores nem libera as Vms das sessões ainda vivas. */
+void vm_sched_free(VmSched *s);
+/*
+ * Nova sessão: vm já carregada (vm_load/vm_reset); a E/S de vm->io é
+ * refeita sobre in_fd/out_fd (podem ser o mesmo socket). 0 se falta
+ * memória ou o epoll recusa o descritor.
+ */
+int vm_sched_add(VmSched *s, Vm *vm, int in_fd, int out_fd, void *user);
+/* Chama fn quando fd fica legível (por exemplo, um socket de escuta). */
+int vm_sched_watch(VmSched *s, int fd, VmHostFn fn, void *ctx);
+/*
+ * Uma rodada: uma fatia para cada sessão pronta e os eventos do epoll,
+ * esperando até timeout_ms (-1 = sem limite) se nenhuma está pronta.
+ * Devolve as sessões vivas, ou -1 se o epoll falhou.
+ */
+int vm_sched_run(VmSched *s, int timeout_ms);
+
+#endif // SBVM_H
@@ -0,0 +1,301 @@
+/*
+ * Tradução antecipada (AOT) de uma imagem verificada para C
+ * (simulador --emit-c). O arquivo gerado é um programa autônomo: compila
+ * com "cc -O2" e se comporta como o simulador com a mesma imagem e o mesmo
+ * --max-steps (mesma saída, mesmas mensagens de erro e código de saída).
+ *
+ * Só imagens com a prova do verificador são traduzidas: o código não muda
+ * e todos os alvos de desvio são operandos imediatos já conhecidos, então
+ * cada desvio vira um goto para o rótulo do alvo, sem tabela de despacho.
+ * ACC e o contador de passos são locais de main; mem é um vetor estático
+ * inicializado com a imagem.
+ *
+ * Os passos são cobrados como no motor threaded com a prova: uma vez por
+ * sequência linear (run_len), na chegada por desvio. Quando a sequência
+ * não cabe no que resta do limite, um interpretador simples termina a
+ * execução passo a passo, para que o erro de limite aconteça no mesmo
+ * ponto do simulador.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "sbvm.h"
+
+/* Parte fixa do programa gerado: E/S com as mesmas regras de sbvm.cpp. */
+static const char AOT_IO[] =
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <limits.h>\n"
+    "#include <unistd.h>\n"
+    "\n"
+    "static char out_buf[1 << 16];\n"
+    "static size_t out_len;\n"
+    "static char in_buf[1 << 16];\n"
+    "static size_t in_pos, in_len;\n"
+    "static int in_eof;\n"
+    "\n"
+    "static void out_flush(void)\n"
+    "{\n"
+    "  size_t done = 0;\n"
+    "  while (done < out_len)\n"
+    "  {\n"
+    "    ssize_t w = write(1, out_buf + done, out_len - done);\n"
+    "    if (w <= 0)\n"
+    "      break;\n"
+    "    done += (size_t)w;\n"
+    "  }\n"
+    "  out_len = 0;\n"
+    "}\n"
+    "\n"
+    "static void put_int(int32_t v)\n"
+    "{\n"
+    "  if (out_len > sizeof out_buf - 16)\n"
+    "    out_flush();\n"
+    "  char tmp[12];\n"
+    "  int n = 0;\n"
+    "  uint32_t u = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;\n"
+    "  do\n"
+    "    tmp[n++] = (char)('0' + u % 10);\n"
+    "  while (u /= 10);\n"
+    "  if (v < 0)\n"
+    "    out_buf[out_len++] = '-';\n"
+    "  while (n)\n"
+    "    out_buf[out_len++] = tmp[--n];\n"
+    "  out_buf[out_len++] = '\\n';\n"
+    "}\n"
+    "\n"
+    "/* Esvazia a saída antes de bloquear lendo a entrada, para que prompts apareçam. */\n"
+    "static int in_peek(void)\n"
+    "{\n"
+    "  if (in_pos == in_len)\n"
+    "  {\n"
+    "    if (in_eof)\n"
+    "      return -1;\n"
+    "    out_flush();\n"
+    "    ssize_t r = read(0, in_buf, sizeof in_buf);\n"
+    "    if (r <= 0)\n"
+    "    {\n"
+    "      in_eof = 1;\n"
+    "      return -1;\n"
+    "    }\n"
+    "    in_pos = 0;\n"
+    "    in_len = (size_t)r;\n"
+    "  }\n"
+    "  return (unsigned char)in_buf[in_pos];\n"
+    "}\n"
+    "\n"
+    "/* Mesmo contrato de scanf(\"%lld\"), saturando fora da faixa. */\n"
+    "static int get_int(long long *out)\n"
+    "{\n"
+    "  int c;\n"
+    "  while ((c = in_peek()) == ' ' || (c >= '\\t' && c <= '\\r'))\n"
+    "    ++in_pos;\n"
+    "  int neg = 0;\n"
+    "  if (c == '-' || c == '+')\n"
+    "  {\n"
+    "    neg = c == '-';\n"
+    "    ++in_pos;\n"
+    "    c = in_peek();\n"
+    "  }\n"
+    "  if (c < '0' || c > '9')\n"
+    "    return 0;\n"
+    "  unsigned long long v = 0;\n"
+    "  int overflow = 0;\n"
+    "  while ((c = in_peek()) >= '0' && c <= '9')\n"
+    "  {\n"
+    "    if (v > (ULLONG_MAX - 9) / 10)\n"
+    "      overflow = 1;\n"
+    "    else\n"
+    "      v = v * 10 + (unsigned)(c - '0');\n"
+    "    ++in_pos;\n"
+    "  }\n"
+    "  if (neg)\n"
+    "    *out = (overflow || v > (unsigned long long)LLONG_MAX + 1) ? LLONG_MIN : (long long)(0 - v);\n"
+    "  else\n"
+    "    *out = (overflow || v > (unsigned long long)LLONG_MAX) ? LLONG_MAX : (long long)v;\n"
+    "  return 1;\n"
+    "}\n"
+    "\n"
+    "static void fail(const char *m)\n"
+    "{\n"
+    "  out_flush();\n"
+    "  fprintf(stderr, \"%s\\n\", m);\n"
+    "  exit(1);\n"
+    "}\n"
+    "\n"
+    "#define ADD(a) ACC = (int32_t)((uint32_t)ACC + (uint32_t)mem[a])\n"
+    "#define SUB(a) ACC = (int32_t)((uint32_t)ACC - (uint32_t)mem[a])\n"
+    "#define MUL(a) ACC = (int32_t)((uint32_t)ACC * (uint32_t)mem[a])\n"
+    "#define DIV(a)                                 \\\n"
+    "  do                                           \\\n"
+    "  {                                            \\\n"
+    "    if (mem[a] == 0)                           \\\n"
+    "      fail(\"Erro: DIV zero\");                  \\\n"
+    "    if (mem[a] == -1 && ACC == INT32_MIN)      \\\n"
+    "      fail(\"Erro: DIV overflow\");              \\\n"
+    "    ACC /= mem[a];                             \\\n"
+    "  } while (0)\n"
+    "#define COPY(a, b) mem[b] = mem[a]\n"
+    "#define LOAD(a) ACC = mem[a]\n"
+    "#define STORE(a) mem[a] = ACC\n"
+    "#define INPUT(a)                  \\\n"
+    "  do                              \\\n"
+    "  {                               \\\n"
+    "    long long v_;                 \\\n"
+    "    if (!get_int(&v_))            \\\n"
+    "      fail(\"Erro: INPUT falha\");  \\\n"
+    "    mem[a] = (int32_t)v_;         \\\n"
+    "  } while (0)\n"
+    "#define OUTPUT(a) put_int(mem[a])\n"
+    "#define STOP()  \\\n"
+    "  do          \\\n"
+    "  {           \\\n"
+    "    out_flush(); \\\n"
+    "    return 0; \\\n"
+    "  } while (0)\n";
+
+/* Depois de mem: o fim da execução perto do limite de passos e a cobrança. */
+static const char AOT_STEPS[] =
+    "/* Fim da execução passo a passo, perto do limite de passos. */\n"
+    "static int slow(uint32_t pc, int32_t ACC, long long steps)\n"
+    "{\n"
+    "  for (;;)\n"
+    "  {\n"
+    "    if (steps++ > MAX_STEPS)\n"
+    "      fail(\"Erro: limite de passos excedido\");\n"
+    "    switch (mem[pc])\n"
+    "    {\n"
+    "    case 1: ADD(mem[pc + 1]); pc += 2; break;\n"
+    "    case 2: SUB(mem[pc + 1]); pc += 2; break;\n"
+    "    case 3: MUL(mem[pc + 1]); pc += 2; break;\n"
+    "    case 4: DIV(mem[pc + 1]); pc += 2; break;\n"
+    "    case 5: pc = (uint32_t)mem[pc + 1]; break;\n"
+    "    case 6: pc = ACC < 0 ? (uint32_t)mem[pc + 1] : pc + 2; break;\n"
+    "    case 7: pc = ACC > 0 ? (uint32_t)mem[pc + 1] : pc + 2; break;\n"
+    "    case 8: pc = ACC == 0 ? (uint32_t)mem[pc + 1] : pc + 2; break;\n"
+    "    case 9: COPY(mem[pc + 1], mem[pc + 2]); pc += 3; break;\n"
+    "    case 10: LOAD(mem[pc + 1]); pc += 2; break;\n"
+    "    case 11: STORE(mem[pc + 1]); pc += 2; break;\n"
+    "    case 12: INPUT(mem[pc + 1]); pc += 2; break;\n"
+    "    case 13: OUTPUT(mem[pc + 1]); pc += 2; break;\n"
+    "    default: STOP();\n"
+    "    }\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "/* Cobra uma sequência linear de n instruções que começa em pc. */\n"
+    "#define RUN(pc, n)                        \\\n"
+    "  do                                      \\\n"
+    "  {                                       \\\n"
+    "    if (steps + (n) - 1 > MAX_STEPS)      \\\n"
+    "      return slow(pc, ACC, steps);        \\\n"
+    "    steps += (n);                         \\\n"
+    "  } while (0)\n";
+
+#define RUN_START 1 // começo de sequência alcançado só pelo fluxo do desvio anterior
+#define RUN_GOTO 2  // começo de sequência alvo de algum goto
+
+int image_emit_c(const Image *img, FILE *out, const char *source, long long max_steps)
+{
+  if (!img->proof.ok)
+    return 0;
+  const int32_t *mem = img->words;
+  // run: começa uma sequência cobrada (entrada, alvo, depois de desvio condicional);
+  // RUN_GOTO marca as que recebem um goto e por isso levam o rótulo B
+  // fall: recebe o fluxo de uma instrução sem cobrar de novo (rótulo C)
+  uint8_t *run = (uint8_t *)calloc(MEM_SIZE + 1, 1);
+  uint8_t *fall = (uint8_t *)calloc(MEM_SIZE + 1, 1);
+  if (!run || !fall)
+  {
+    free(run);
+    free(fall);
+    return 0;
+  }
+  run[img->entry] = RUN_GOTO;
+  for (uint32_t pc = 0; pc < MEM_SIZE; ++pc)
+  {
+    int32_t op = mem[pc];
+    if (!img->run_len[pc] || op < 5 || op > 8)
+      continue; // run_len só é não nulo no início de instruções alcançáveis
+    run[(uint32_t)mem[pc + 1]] = RUN_GOTO;
+    if (op != 5)
+      run[pc + 2] |= img->run_len[pc + 1] ? RUN_GOTO : RUN_START; // ver o desvio condicional abaixo
+  }
+
+  fprintf(out, "/* Gerado por simulador --emit-c a partir de %s; não editar. */\n", source);
+  fprintf(out, "#define MAX_STEPS %lldLL\n", max_steps);
+  fputs(AOT_IO, out);
+
+  size_t n = img->n;
+  while (n > 0 && mem[n - 1] == 0)
+    --n;
+  fprintf(out, "\nstatic int32_t mem[%d] = {", MEM_SIZE);
+  for (size_t i = 0; i < n; ++i)
+    fprintf(out, "%s%d,", i % 16 ? " " : "\n  ", mem[i]);
+  fprintf(out, "\n};\n\n");
+  fputs(AOT_STEPS, out);
+  fprintf(out, "\nint main(void)\n{\n  int32_t ACC = 0;\n  long long steps = 0;\n");
+  fprintf(out, "  goto B%u;\n", img->entry);
+
+  // o sucessor pelo fluxo está sempre à frente: o rótulo C ainda vai ser emitido
+  int through = 0; // a instrução anterior segue para expect
+  uint32_t expect = MEM_SIZE;
+  for (uint32_t pc = 0; pc < MEM_SIZE; ++pc)
+  {
+    if (!img->run_len[pc])
+      continue;
+    int32_t op = mem[pc];
+    if (through && expect != pc)
+    {
+      fprintf(out, "  goto C%u;\n", expect);
+      fall[expect] = 1;
+    }
+    if (run[pc])
+    {
+      if (through && expect == pc)
+      {
+        fprintf(out, "  goto C%u;\n", pc); // chegada pelo fluxo: já cobrada
+        fall[pc] = 1;
+      }
+      if (run[pc] & RUN_GOTO)
+        fprintf(out, "B%u:\n", pc);
+      fprintf(out, "  RUN(%u, %u);\n", pc, img->run_len[pc]);
+    }
+    if (fall[pc])
+      fprintf(out, "C%u:\n", pc);
+
+    uint32_t a = ISA[op].operands ? (uint32_t)mem[pc + 1] : 0;
+    uint32_t next = pc + op_size(op);
+    switch (op)
+    {
+    case 5:
+      fprintf(out, "  goto B%u; // %u: JMP\n", a, pc);
+      break;
+    case 6:
+    case 7:
+    case 8:
+      fprintf(out, "  if (ACC %s 0)\n    goto B%u; // %u: %s\n", op == 6 ? "<" : op == 7 ? ">" : "==", a, pc,
+              ISA[op].mnemonic);
+      if (img->run_len[pc + 1]) // outra instrução começa no operando: next não é a próxima emitida
+        fprintf(out, "  goto B%u;\n", next);
+      break;
+    case 9:
+      fprintf(out, "  COPY(%u, %u); // %u\n", a, (uint32_t)mem[pc + 2], pc);
+      break;
+    case 14:
+      fprintf(out, "  STOP(); // %u\n", pc);
+      break;
+    default:
+      fprintf(out, "  %s(%u); // %u\n", ISA[op].mnemonic, a, pc);
+      break;
+    }
+    through = !isa_jumps(op) && !isa_stops(op);
+    expect = next;
+  }
+  fprintf(out, "}\n");
+  free(run);
+  free(fall);
+  return !ferror(out);
+}
@@ -0,0 +1,521 @@
+/*
+ * Motor em lanes (simulador --batch --lanes): o mesmo programa verificado
+ * rodando sobre as entradas de vários jobs ao mesmo tempo, um job por
+ * lane. ACC e a memória ficam em estrutura de vetores (mem[a][lane]), e
+ * cada instrução é executada para todos os lanes de um grupo com uma
+ * operação vetorial (extensões de vetor do GCC; AVX2 quando o processador
+ * tem, via target_clones).
+ *
+ * Os lanes de um grupo compartilham o PC. Num desvio condicional em que os
+ * lanes discordam, o grupo se divide e cada lane guarda o próprio PC. O
+ * escalonador sempre roda o grupo de menor PC, com máscara, até ele
+ * alcançar o PC de outro lane, onde os dois grupos se juntam de novo
+ * (reconvergência pelo menor PC). Lanes que terminam são reabastecidos com
+ * o próximo job da mesma imagem, que reconverge com os outros do mesmo
+ * jeito.
+ *
+ * Um lane que espera mais de LANE_WAIT_LIMIT passos ganha a vez e roda
+ * sozinho por até LANE_WAIT_LIMIT passos. O que não termina nessa vez, o
+ * que chega ao limite de passos ou que fica sozinho sem mais jobs passa
+ * para o motor escalar (uma Vm comum, com a memória do lane copiada das
+ * páginas graváveis) e termina lá. Como a prova garante que só as páginas de write_page mudam,
+ * essa cópia é pequena, e o motor escalar cuida de erros de limite e da
+ * contagem exata de passos.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "sbvm.h"
+
+#define LANE_WAIT_LIMIT 4096 // passos que um lane espera antes de passar na frente
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#if VM_LANES == 16
+#define LANES_TARGET __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define LANES_TARGET __attribute__((target_clones("avx2", "default")))
+#endif
+#else
+#define LANES_TARGET
+#endif
+
+typedef int32_t vlane __attribute__((vector_size(4 * VM_LANES)));
+typedef uint32_t vulane __attribute__((vector_size(4 * VM_LANES)));
+typedef int32_t vi8 __attribute__((vector_size(32)));
+typedef double vd8 __attribute__((vector_size(64)));
+
+struct VmLanes
+{
+  vlane acc;
+  VmConfig cfg;
+  int32_t *mem;           // mem[a * VM_LANES + lane]
+  const Image *img;       // imagem em mem; NULL = ainda não carregada
+  long job[VM_LANES];     // -1: lane livre
+  uint32_t pc[VM_LANES];
+  long long steps[VM_LANES];
+  long long wait[VM_LANES]; // passos seguidos esperando outro grupo
+  uint32_t live;            // bit l: lane l tem job
+  long long group_steps;    // instruções despachadas para grupos
+  long long lane_steps;     // instruções executadas somando os lanes
+  long long peeled;         // lanes terminados no motor escalar
+  Io io[VM_LANES];
+};
+
+#define LANES_MEM_BYTES ((size_t)MEM_SIZE * VM_LANES * sizeof(int32_t))
+
+VmLanes *vm_lanes_new(const VmConfig *cfg)
+{
+  void *p = mmap(NULL, sizeof(VmLanes), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+  VmLanes *l = (VmLanes *)p;
+  l->cfg = *cfg;
+  p = mmap(NULL, LANES_MEM_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED)
+  {
+    munmap(l, sizeof(VmLanes));
+    return NULL;
+  }
+  l->mem = (int32_t *)p;
+  for (int i = 0; i < VM_LANES; ++i)
+  {
+    l->job[i] = -1;
+    io_reset(&l->io[i], -1, -1, 0);
+  }
+  return l;
+}
+
+void vm_lanes_free(VmLanes *l)
+{
+  if (!l)
+    return;
+  for (int i = 0; i < VM_LANES; ++i)
+  {
+    io_reset(&l->io[i], -1, -1, 0);
+    free(l->io[i].cap);
+  }
+  munmap(l->mem, LANES_MEM_BYTES);
+  munmap(l, sizeof(VmLanes));
+}
+
+void vm_lanes_stats(const VmLanes *l, long long *group_steps, long long *lane_steps, long long *peeled)
+{
+  *group_steps = l->group_steps;
+  *lane_steps = l->lane_steps;
+  *peeled = l->peeled;
+}
+
+/* Memória de todos os lanes = imagem. */
+static void lanes_load(VmLanes *l, const Image *img)
+{
+  if (l->img)
+    madvise(l->mem, LANES_MEM_BYTES, MADV_DONTNEED);
+  for (size_t a = 0; a < img->n; ++a)
+    for (int i = 0; i < VM_LANES; ++i)
+      l->mem[a * VM_LANES + i] = img->words[a];
+  l->img = img;
+}
+
+/* Coluna de um lane = imagem; só as páginas graváveis podem ter mudado. */
+static void lane_reset(VmLanes *l, int i)
+{
+  const Image *img = l->img;
+  for (uint32_t p = 0; p < VM_PAGES; ++p)
+    if (img->write_page[p])
+      for (uint32_t a = p * VM_PAGE_WORDS; a < (p + 1) * VM_PAGE_WORDS; ++a)
+        l->mem[(size_t)a * VM_LANES + i] = img->words[a];
+  l->acc[i] = 0;
+  l->pc[i] = img->entry;
+  l->steps[i] = 0;
+  l->wait[i] = 0;
+}
+
+static void lane_finish(VmLanes *l, int i, int status, long long steps, const char *err, LaneDoneFn done,
+                        void *ctx)
+{
+  io_flush(&l->io[i]);
+  done(ctx, l->job[i], status, steps, err, &l->io[i]);
+  l->job[i] = -1;
+  l->live &= ~(1u << i);
+}
+
+static int lane_input(void *ctx, long long, long long *v)
+{
+  return io_next_int((Io *)ctx, v);
+}
+
+static void lane_output(void *ctx, int32_t v)
+{
+  io_put_int((Io *)ctx, v);
+}
+
+/* Termina o lane i no motor escalar, a partir do estado atual. */
+static void lane_peel(VmLanes *l, int i, Vm *vm, LaneDoneFn done, void *ctx)
+{
+  const Image *img = l->img;
+  if (vm->img == img)
+    vm_reset(vm);
+  else
+    vm_load(vm, img);
+  for (uint32_t p = 0; p < VM_PAGES; ++p)
+    if (img->write_page[p])
+      for (uint32_t a = p * VM_PAGE_WORDS; a < (p + 1) * VM_PAGE_WORDS; ++a)
+        vm->mem[a] = l->mem[(size_t)a * VM_LANES + i];
+  vm->cpu.ACC = l->acc[i];
+  vm->cpu.PC = l->pc[i];
+  vm->cpu.steps = l->steps[i];
+  vm_set_io(vm, lane_input, lane_output, &l->io[i]);
+  int rc = vm_run(vm, 0);
+  vm_set_io(vm, NULL, NULL, NULL);
+  ++l->peeled;
+  lane_finish(l, i, rc, vm->cpu.steps, rc ? vm->err : NULL, done, ctx);
+}
+
+/* Por ponteiro: vetores de 32 bytes por valor mudam de ABI conforme -mavx. */
+static inline void lane_mask(vlane *m, uint32_t bits)
+{
+  for (int i = 0; i < VM_LANES; ++i)
+    (*m)[i] = (bits >> i & 1) ? -1 : 0;
+}
+
+static inline uint32_t mask_bits(const vlane *m)
+{
+  uint32_t bits = 0;
+  for (int i = 0; i < VM_LANES; ++i)
+    bits |= (uint32_t)((*m)[i] & 1) << i;
+  return bits;
+}
+
+/*
+ * q = n / d truncado: o quociente de inteiros de 32 bits é exato em double.
+ * Em pedaços de 8, porque vetores de double maiores que isso o GCC quebra mal.
+ */
+static inline void lanes_div(vlane *q, const vlane *n, const vlane *d)
+{
+  for (int h = 0; h < VM_LANES; h += 8)
+  {
+    vi8 nh, dh, qh;
+    memcpy(&nh, (const int32_t *)n + h, sizeof nh);
+    memcpy(&dh, (const int32_t *)d + h, sizeof dh);
+    qh = __builtin_convertvector(__builtin_convertvector(nh, vd8) / __builtin_convertvector(dh, vd8), vi8);
+    memcpy((int32_t *)q + h, &qh, sizeof qh);
+  }
+}
+
+#define ROW(a) (*(vlane *)(mem + (size_t)(a) * VM_LANES))
+// dst = v nos lanes do grupo (máscara M)
+#define BLEND(dst, v)            \
+  do                             \
+  {                              \
+    vlane v_ = (v);              \
+    dst = (v_ & M) | (dst & ~M); \
+  } while (0)
+// para cada lane i do grupo
+#define FOR_LANES(i)                           \
+  for (uint32_t b_ = bits; b_; b_ &= b_ - 1) \
+    for (int i = __builtin_ctz(b_), once_ = 1; once_; once_ = 0)
+
+/*
+ * Próximo grupo: os lanes no menor PC, que param no PC do próximo lane; ou,
+ * se um lane esperou demais, o grupo dele (*starved), sem ponto de parada.
+ * Devolve o maior número de passos entre os lanes do grupo.
+ */
+static inline long long lanes_pick(const VmLanes *l, uint32_t *pc_out, uint32_t *bits_out,
+                                   uint32_t *stop_out, int *starved)
+{
+  uint32_t pc = UINT32_MAX, stop_pc = UINT32_MAX, bits = 0;
+  long long top = 0;
+  *starved = 0;
+  for (uint32_t b = l->live; b; b &= b - 1)
+  {
+    int i = __builtin_ctz(b);
+    if (l->wait[i] > LANE_WAIT_LIMIT)
+    {
+      pc = l->pc[i];
+      *starved = 1;
+      break;
+    }
+    if (l->pc[i] < pc)
+      pc = l->pc[i];
+  }
+  for (uint32_t b = l->live; b; b &= b - 1)
+  {
+    int i = __builtin_ctz(b);
+    if (l->pc[i] == pc)
+    {
+      bits |= 1u << i;
+      if (l->steps[i] > top)
+        top = l->steps[i];
+    }
+    else if (!*starved && l->pc[i] < stop_pc)
+      stop_pc = l->pc[i];
+  }
+  *pc_out = pc;
+  *bits_out = bits;
+  *stop_out = stop_pc;
+  return top;
+}
+
+/*
+ * Roda o grupo bits (todos com PC = pc). Num desvio em que os lanes
+ * discordam, segue com a metade de menor PC; ao alcançar stop_pc, junta os
+ * lanes que estão lá e escolhe o próximo grupo. Volta ao chamador quando
+ * um lane termina ou quando lanes_pick pede um grupo que esperou demais
+ * (ou perto do limite de passos); a cada room instruções lanes_pick é
+ * consultado de novo. Com starved, roda só o grupo dado, até room.
+ */
+LANES_TARGET
+static void lanes_group(VmLanes *l, uint32_t PC, uint32_t bits, uint32_t stop_pc, long long room,
+                        int starved, LaneDoneFn done, void *ctx)
+{
+  const int32_t *w = l->img->words;
+  int32_t *mem = l->mem;
+  const long long max_steps = l->cfg.max_steps;
+  vlane acc = l->acc;
+  vlane M;
+  lane_mask(&M, bits);
+  long long k = 0;
+  int finished = 0;
+
+// passos do grupo até aqui vão para os lanes; quem não está no grupo espera
+#define FLUSH()                                              \
+  do                                                         \
+  {                                                          \
+    FOR_LANES(i)                                             \
+    {                                                        \
+      l->steps[i] += k;                                      \
+      l->pc[i] = PC;                                         \
+      l->wait[i] = 0;                                        \
+    }                                                        \
+    for (uint32_t b = l->live & ~bits; b; b &= b - 1)        \
+      l->wait[__builtin_ctz(b)] += k;                        \
+    l->group_steps += k;                                     \
+    l->lane_steps += k * __builtin_popcount(bits);           \
+    room -= k;                                               \
+    k = 0;                                                   \
+  } while (0)
+
+  // despacho por computed goto, como no motor threaded
+  const void *const ops[15] = {&&op_bad,  &&op_add,  &&op_sub,   &&op_mul,   &&op_div,
+                               &&op_jmp,  &&op_jmpc, &&op_jmpc,  &&op_jmpc,  &&op_copy,
+                               &&op_load, &&op_store, &&op_input, &&op_output, &&op_stop};
+  int32_t op;
+#define DISPATCH()                                       \
+  do                                                     \
+  {                                                      \
+    if (k >= room || PC >= stop_pc)                      \
+      goto slice_end;                                    \
+    ++k;                                                 \
+    op = w[PC];                                          \
+    goto *ops[(uint32_t)op < 15 ? op : 0];               \
+  } while (0)
+#define A ((uint32_t)w[PC + 1])
+
+  DISPATCH();
+op_add:
+  BLEND(acc, (vlane)((vulane)acc + (vulane)ROW(A)));
+  PC += 2;
+  DISPATCH();
+op_sub:
+  BLEND(acc, (vlane)((vulane)acc - (vulane)ROW(A)));
+  PC += 2;
+  DISPATCH();
+op_mul:
+  BLEND(acc, (vlane)((vulane)acc * (vulane)ROW(A)));
+  PC += 2;
+  DISPATCH();
+op_div:
+{
+  // divisor zero e INT32_MIN / -1 terminam o lane com erro, como nos
+  // outros motores
+  uint32_t a = A;
+  vlane d = ROW(a), n = acc, q = n;
+  vlane odd = (d == 0) | ((acc == INT32_MIN) & (d == -1));
+  uint32_t slow = mask_bits(&odd) & bits;
+  d |= odd & 1;
+  lanes_div(&q, &n, &d);
+  BLEND(acc, q);
+  for (uint32_t b = slow; b; b &= b - 1)
+  {
+    int i = __builtin_ctz(b);
+    int32_t di = mem[(size_t)a * VM_LANES + i];
+    acc[i] = n[i]; // o ACC de antes do DIV, como nos outros motores
+    l->acc = acc;
+    lane_finish(l, i, 1, l->steps[i] + k, di == 0 ? "Erro: DIV zero" : "Erro: DIV overflow", done, ctx);
+    bits &= ~(1u << i);
+    finished = 1;
+  }
+  PC += 2;
+  if (slow)
+  {
+    if (!bits)
+      goto slice_end;
+    lane_mask(&M, bits);
+  }
+  DISPATCH();
+}
+op_jmp:
+  PC = A;
+  DISPATCH();
+op_jmpc:
+{
+  uint32_t a = A;
+  vlane c = op == 6 ? acc < 0 : op == 7 ? acc > 0 : acc == 0;
+  uint32_t taken = mask_bits(&c) & bits;
+  if (taken == bits || a == PC + 2)
+    PC = a;
+  else if (!taken)
+    PC += 2;
+  else
+  {
+    // divide: a metade de PC maior espera, a outra segue
+    uint32_t low = a < PC + 2 ? taken : bits & ~taken;
+    uint32_t hi_pc = a < PC + 2 ? PC + 2 : a;
+    PC = a < PC + 2 ? a : PC + 2;
+    FLUSH();
+    for (uint32_t b = bits & ~low; b; b &= b - 1)
+      l->pc[__builtin_ctz(b)] = hi_pc;
+    bits = low;
+    lane_mask(&M, bits);
+    if (hi_pc < stop_pc)
+      stop_pc = hi_pc;
+    if (starved)
+      stop_pc = PC; // a vez do grupo acaba aqui
+  }
+  DISPATCH();
+}
+op_copy:
+  BLEND(ROW(w[PC + 2]), ROW(A));
+  PC += 3;
+  DISPATCH();
+op_load:
+  BLEND(acc, ROW(A));
+  PC += 2;
+  DISPATCH();
+op_store:
+  BLEND(ROW(A), acc);
+  PC += 2;
+  DISPATCH();
+op_input:
+{
+  uint32_t a = A;
+  FOR_LANES(i)
+  {
+    long long v;
+    if (io_next_int(&l->io[i], &v) > 0)
+      mem[(size_t)a * VM_LANES + i] = (int32_t)v;
+    else
+    {
+      l->acc = acc;
+      lane_finish(l, i, 1, l->steps[i] + k, "Erro: INPUT falha", done, ctx);
+      bits &= ~(1u << i);
+      finished = 1;
+    }
+  }
+  PC += 2;
+  if (!bits)
+    goto slice_end;
+  lane_mask(&M, bits);
+  DISPATCH();
+}
+op_output:
+{
+  uint32_t a = A;
+  FOR_LANES(i)
+  io_put_int(&l->io[i], mem[(size_t)a * VM_LANES + i]);
+  PC += 2;
+  DISPATCH();
+}
+op_bad:
+{
+  // a prova garante opcodes válidos no caminho; fica só por segurança
+  char err[64];
+  snprintf(err, sizeof err, "Opcode desconhecido %d em PC=%u", op, PC);
+  l->acc = acc;
+  FOR_LANES(i)
+  lane_finish(l, i, 1, l->steps[i] + k, err, done, ctx);
+  bits = 0;
+  finished = 1;
+  goto slice_end;
+}
+op_stop:
+  l->acc = acc;
+  FOR_LANES(i)
+  lane_finish(l, i, 0, l->steps[i] + k, NULL, done, ctx);
+  bits = 0;
+  finished = 1;
+
+slice_end:
+  FLUSH();
+  if (!finished && bits && !starved)
+  {
+    // chegou ao PC de outro lane ou ao fim da fatia: escolhe o próximo grupo
+    int again;
+    long long top = lanes_pick(l, &PC, &bits, &stop_pc, &again);
+    if (!again && top < max_steps)
+    {
+      room = max_steps - top < LANE_WAIT_LIMIT ? max_steps - top : LANE_WAIT_LIMIT;
+      lane_mask(&M, bits);
+      DISPATCH();
+    }
+  }
+#undef A
+#undef DISPATCH
+#undef FLUSH
+  l->acc = acc;
+}
+
+int vm_lanes_run(VmLanes *l, const Image *img, Vm *vm, LaneNextFn next, LaneDoneFn done, void *ctx)
+{
+  if (!img->proof.ok)
+    return 0;
+  if (l->img != img)
+    lanes_load(l, img);
+  const long long max_steps = l->cfg.max_steps;
+  int drained = 0;
+  while (1)
+  {
+    for (int i = 0; i < VM_LANES && !drained && l->live != (1u << VM_LANES) - 1; ++i)
+    {
+      if (l->job[i] >= 0)
+        continue;
+      io_reset(&l->io[i], -1, -1, 0);
+      long job = next(ctx, &l->io[i]);
+      if (job < 0)
+      {
+        drained = 1;
+        break;
+      }
+      l->job[i] = job;
+      l->live |= 1u << i;
+      lane_reset(l, i);
+    }
+    if (!l->live)
+      break;
+    if (drained && !(l->live & (l->live - 1)))
+    {
+      lane_peel(l, __builtin_ctz(l->live), vm, done, ctx); // sozinho, o motor escalar é mais rápido
+      continue;
+    }
+
+    uint32_t pc, bits, stop_pc;
+    int starved;
+    long long top = lanes_pick(l, &pc, &bits, &stop_pc, &starved);
+    if (top >= max_steps)
+    {
+      // perto do limite: o motor escalar dá o erro (ou o STOP) no passo exato
+      for (uint32_t b = bits; b; b &= b - 1)
+        if (l->steps[__builtin_ctz(b)] >= max_steps)
+          lane_peel(l, __builtin_ctz(b), vm, done, ctx);
+      continue;
+    }
+    long long room = max_steps - top < LANE_WAIT_LIMIT ? max_steps - top : LANE_WAIT_LIMIT;
+    lanes_group(l, pc, bits, stop_pc, room, starved, done, ctx);
+    if (starved)
+      for (uint32_t b = l->live & bits; b; b &= b - 1)
+        lane_peel(l, __builtin_ctz(b), vm, done, ctx); // não terminou na sua vez: divergente
+  }
+  return 1;
+}
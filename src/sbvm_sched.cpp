@@ -0,0 +1,382 @@
+/*
+ * Escalonador de sessões (simulador --listen): milhares de Vms interativas
+ * em uma única thread, em vez de um processo por sessão.
+ *
+ * A Vm já é uma corrotina sem pilha: vm_run guarda ACC, PC e passos em
+ * vm->cpu a cada saída e continua dali na próxima chamada. Com os
+ * descritores em O_NONBLOCK, um INPUT sem dados ou um OUTPUT com o buffer
+ * cheio saem de vm_run com VM_WAIT_INPUT/VM_WAIT_OUTPUT antes de executar
+ * a instrução. A sessão deixa a fila de prontas e o descritor é armado no
+ * epoll; quando ele fica pronto, a sessão volta para a fila e o INPUT ou
+ * OUTPUT roda de novo. Sessões que só calculam rodam fatias de slice
+ * instruções (VM_PAUSED) e vão para o fim da fila, para não segurar as
+ * outras.
+ *
+ * Os descritores são registrados com EPOLLONESHOT: cada um é armado só
+ * enquanto a sessão espera por ele, então uma sessão pronta ou rodando
+ * nunca gera eventos repetidos (nem de EPOLLHUP). Ao terminar, a sessão
+ * espera a saída pendente ser entregue antes de chamar done.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include "sbvm.h"
+
+#define SCHED_EVENTS 256 // eventos por epoll_wait
+
+enum
+{
+  W_IN = 1,  // entrada da sessão
+  W_OUT = 2, // saída da sessão (W_IN | W_OUT: o mesmo descritor)
+  W_HOST = 4 // descritor do hospedeiro (vm_sched_watch)
+};
+
+enum
+{
+  S_RUN,      // roda na próxima vez que sair da fila
+  S_WAIT_IN,  // INPUT esperando dados (e a saída pendente, se houver)
+  S_WAIT_OUT, // OUTPUT esperando espaço no descritor
+  S_DRAIN,    // terminou; entregando a saída pendente
+  S_DEAD      // done já chamado; liberada no fim da rodada
+};
+
+struct Session;
+
+typedef struct
+{
+  int kind;
+  int fd;
+  uint32_t armed; // eventos armados no epoll; 0 = desarmado
+  int polled;     // 0: arquivo comum, que o epoll não aceita (e nunca bloqueia)
+  struct Session *s;
+  VmHostFn fn;
+  void *ctx;
+} Watch;
+
+typedef struct Session
+{
+  Vm *vm;
+  void *user;
+  int state;
+  int queued;           // na fila de prontas
+  int status;           // resultado final de vm_run
+  Watch in, out;        // out só é usado com descritores diferentes
+  struct Session *next; // fila de prontas ou lista de mortas
+  struct Session *prev_all, *next_all; // todas as vivas
+} Session;
+
+struct VmSched
+{
+  int ep;
+  long long slice;
+  VmSessionDoneFn done;
+  void *ctx;
+  Session *head, *tail; // prontas, em ordem
+  Session *dead;        // eventos desta rodada ainda podem apontar para elas
+  Session *all;         // vivas, para vm_sched_free
+  Watch **hosts;
+  int nhosts;
+  int live;
+};
+
+VmSched *vm_sched_new(long long slice, VmSessionDoneFn done, void *ctx)
+{
+  VmSched *s = (VmSched *)calloc(1, sizeof(VmSched));
+  if (!s)
+    return NULL;
+  s->ep = epoll_create1(EPOLL_CLOEXEC);
+  if (s->ep < 0)
+  {
+    free(s);
+    return NULL;
+  }
+  s->slice = slice > 0 ? slice : 1;
+  s->done = done;
+  s->ctx = ctx;
+  return s;
+}
+
+static void free_dead(VmSched *s)
+{
+  while (s->dead)
+  {
+    Session *x = s->dead;
+    s->dead = x->next;
+    free(x);
+  }
+}
+
+void vm_sched_free(VmSched *s)
+{
+  if (!s)
+    return;
+  free_dead(s);
+  while (s->all)
+  {
+    Session *x = s->all;
+    s->all = x->next_all;
+    free(x);
+  }
+  for (int i = 0; i < s->nhosts; ++i)
+    free(s->hosts[i]);
+  free(s->hosts);
+  close(s->ep);
+  free(s);
+}
+
+static int watch_add(VmSched *s, Watch *w, uint32_t events)
+{
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof ev);
+  ev.events = events;
+  ev.data.ptr = w;
+  if (epoll_ctl(s->ep, EPOLL_CTL_ADD, w->fd, &ev) == 0)
+  {
+    w->polled = 1;
+    return 1;
+  }
+  return errno == EPERM; // arquivo comum: leitura e escrita nunca devolvem EAGAIN
+}
+
+static void watch_del(VmSched *s, Watch *w)
+{
+  if (w->polled)
+    epoll_ctl(s->ep, EPOLL_CTL_DEL, w->fd, NULL);
+  w->polled = 0;
+}
+
+/* Arma w para events (0 desarma); 0 se não há como esperar por ele. */
+static int arm(VmSched *s, Watch *w, uint32_t events)
+{
+  if (!w->polled)
+    return 0;
+  if (w->armed == events)
+    return events != 0;
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof ev);
+  ev.events = events | EPOLLONESHOT;
+  ev.data.ptr = w;
+  if (epoll_ctl(s->ep, EPOLL_CTL_MOD, w->fd, &ev) < 0)
+    return 0;
+  w->armed = events;
+  return events != 0;
+}
+
+static void push_ready(VmSched *s, Session *x)
+{
+  if (x->queued)
+    return;
+  x->queued = 1;
+  x->next = NULL;
+  if (s->tail)
+    s->tail->next = x;
+  else
+    s->head = x;
+  s->tail = x;
+}
+
+/* Espera entrada e/ou espaço na saída; sem nada que o epoll possa vigiar, volta a ficar pronta. */
+static void session_wait(VmSched *s, Session *x, int state, int in, int out)
+{
+  int armed;
+  if (x->in.kind & W_OUT)
+    armed = arm(s, &x->in, (in ? EPOLLIN : 0) | (out ? EPOLLOUT : 0));
+  else
+    armed = arm(s, &x->in, in ? EPOLLIN : 0) | arm(s, &x->out, out ? EPOLLOUT : 0);
+  x->state = state;
+  if (!armed)
+    push_ready(s, x);
+}
+
+static void session_finish(VmSched *s, Session *x)
+{
+  watch_del(s, &x->in);
+  if (!(x->in.kind & W_OUT))
+    watch_del(s, &x->out);
+  x->state = S_DEAD;
+  if (x->prev_all)
+    x->prev_all->next_all = x->next_all;
+  else
+    s->all = x->next_all;
+  if (x->next_all)
+    x->next_all->prev_all = x->prev_all;
+  x->next = s->dead;
+  s->dead = x;
+  --s->live;
+  s->done(s->ctx, x->vm, x->status, x->user);
+}
+
+static void session_step(VmSched *s, Session *x)
+{
+  Io *io = &x->vm->io;
+  if (x->state == S_DRAIN)
+  {
+    io_flush(io);
+    if (io_pending(io))
+      session_wait(s, x, S_DRAIN, 0, 1);
+    else
+      session_finish(s, x);
+    return;
+  }
+  int rc = vm_run(x->vm, s->slice);
+  io_flush(io);
+  x->state = S_RUN;
+  if (rc == VM_PAUSED)
+    push_ready(s, x);
+  else if (rc == VM_WAIT_INPUT)
+    session_wait(s, x, S_WAIT_IN, 1, io_pending(io) > 0); // o prompt tem que chegar antes
+  else if (rc == VM_WAIT_OUTPUT)
+    session_wait(s, x, S_WAIT_OUT, 0, 1);
+  else
+  {
+    x->status = rc;
+    x->state = S_DRAIN;
+    if (io_pending(io))
+      session_wait(s, x, S_DRAIN, 0, 1);
+    else
+      session_finish(s, x);
+  }
+}
+
+static void session_event(VmSched *s, Watch *w, uint32_t ev)
+{
+  Session *x = w->s;
+  w->armed = 0; // EPOLLONESHOT: desarmado até o próximo arm
+  if (x->state == S_DEAD)
+    return;
+  if (x->queued)
+  {
+    if (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+      io_flush(&x->vm->io);
+    return; // já vai rodar
+  }
+  const uint32_t gone = EPOLLHUP | EPOLLERR;
+  int in_ready = (w->kind & W_IN) && (ev & (EPOLLIN | gone));
+  int out_ready = (w->kind & W_OUT) && (ev & (EPOLLOUT | gone));
+  Io *io = &x->vm->io;
+  if (out_ready)
+    io_flush(io); // num erro a saída é descartada e o pendente zera
+  switch (x->state)
+  {
+  case S_WAIT_IN:
+    if (in_ready)
+      push_ready(s, x);
+    else
+      session_wait(s, x, S_WAIT_IN, 1, io_pending(io) > 0);
+    break;
+  case S_WAIT_OUT:
+    if (out_ready)
+      push_ready(s, x);
+    else
+      session_wait(s, x, S_WAIT_OUT, 0, 1);
+    break;
+  case S_DRAIN:
+    if (!io_pending(io))
+      session_finish(s, x);
+    else
+      session_wait(s, x, S_DRAIN, 0, 1);
+    break;
+  default:
+    break;
+  }
+}
+
+static int set_nonblock(int fd)
+{
+  int fl = fcntl(fd, F_GETFL);
+  return fl >= 0 && (fl & O_NONBLOCK || fcntl(fd, F_SETFL, fl | O_NONBLOCK) == 0);
+}
+
+int vm_sched_add(VmSched *s, Vm *vm, int in_fd, int out_fd, void *user)
+{
+  Session *x = (Session *)calloc(1, sizeof(Session));
+  if (!x || !set_nonblock(in_fd) || !set_nonblock(out_fd))
+  {
+    free(x);
+    return 0;
+  }
+  x->vm = vm;
+  x->user = user;
+  x->in.kind = in_fd == out_fd ? W_IN | W_OUT : W_IN;
+  x->in.fd = in_fd;
+  x->in.s = x;
+  x->out.kind = W_OUT;
+  x->out.fd = out_fd;
+  x->out.s = x;
+  // desarmados: EPOLLONESHOT sem eventos só avisa de um EPOLLHUP
+  if (!watch_add(s, &x->in, EPOLLONESHOT) ||
+      (in_fd != out_fd && !watch_add(s, &x->out, EPOLLONESHOT)))
+  {
+    watch_del(s, &x->in);
+    free(x);
+    return 0;
+  }
+  io_reset(&vm->io, out_fd, in_fd, 0);
+  x->state = S_RUN;
+  x->next_all = s->all;
+  if (s->all)
+    s->all->prev_all = x;
+  s->all = x;
+  push_ready(s, x);
+  ++s->live;
+  return 1;
+}
+
+int vm_sched_watch(VmSched *s, int fd, VmHostFn fn, void *ctx)
+{
+  Watch *w = (Watch *)calloc(1, sizeof(Watch));
+  Watch **hosts = w ? (Watch **)realloc(s->hosts, (s->nhosts + 1) * sizeof *hosts) : NULL;
+  if (!hosts)
+  {
+    free(w);
+    return 0;
+  }
+  s->hosts = hosts;
+  w->kind = W_HOST;
+  w->fd = fd;
+  w->fn = fn;
+  w->ctx = ctx;
+  if (!watch_add(s, w, EPOLLIN) || !w->polled)
+  {
+    free(w);
+    return 0;
+  }
+  s->hosts[s->nhosts++] = w;
+  return 1;
+}
+
+int vm_sched_run(VmSched *s, int timeout_ms)
+{
+  // só as prontas no início da rodada: as que voltam para a fila ficam para a próxima
+  Session *last = s->tail;
+  while (s->head)
+  {
+    Session *x = s->head;
+    s->head = x->next;
+    if (!s->head)
+      s->tail = NULL;
+    x->queued = 0;
+    session_step(s, x);
+    if (x == last)
+      break;
+  }
+
+  struct epoll_event ev[SCHED_EVENTS];
+  // sessões que terminaram nesta rodada: o hospedeiro pode querer ver os done logo
+  int n = epoll_wait(s->ep, ev, SCHED_EVENTS, s->head || s->dead ? 0 : timeout_ms);
+  if (n < 0 && errno != EINTR)
+    return -1;
+  for (int i = 0; i < n; ++i)
+  {
+    Watch *w = (Watch *)ev[i].data.ptr;
+    if (w->kind == W_HOST)
+      w->fn(w->ctx, w->fd);
+    else
+      session_event(s, w, ev[i].events);
+  }
+  free_dead(s);
+  return s->live;
+}
@@ -1,64 +1,240 @@
 /*
  * Simulador da máquina hipotética (Software Básico - UnB)
- * Formato .o2: uma LINHA com inteiros separados por espaço.
+ * Driver de linha de comando sobre libsbvm (sbvm.h), que tem o conjunto de
+ * instruções, os motores e o verificador.
  *
- * OPCODES:
- * 01 ADD op     ACC = ACC + mem[op]
- * 02 SUB op     ACC = ACC - mem[op]
- * 03 MUL op     ACC = ACC * mem[op]
- * 04 DIV op     ACC = ACC / mem[op]         (erro se mem[op] == 0)
- * 05 JMP op     PC = op
- * 06 JMPN op    if (ACC < 0) PC = op
- * 07 JMPP op    if (ACC > 0) PC = op
- * 08 JMPZ op    if (ACC == 0) PC = op
- * 09 COPY a b   mem[b] = mem[a]
- * 10 LOAD op    ACC = mem[op]
- * 11 STORE op   mem[op] = ACC
- * 12 INPUT op   lê int do stdin -> mem[op]
- * 13 OUTPUT op  imprime mem[op]\n
- * 14 STOP       halt
+ * Uso:
+ *   g++ -O2 -pthread -o simulador simulador.cpp sbvm.cpp sbvm_aot.cpp sbvm_lanes.cpp sbvm_sched.cpp
+ *   ./simulador programa.o2|programa.o2b [--trace] [--max-steps=N] [--engine=threaded|switch|jit]
+ *                [--no-fusion] [--fusion-stats] [--timing] [--no-verify] [--verify-only]
+ *                [--interactive] [--input-file=arq] [--profile=arq.json]
+ *                [--checkpoint-every=N] [--checkpoint-dir=dir] [--restore=snapshot]
+ *                [--trace-file=arq.sbt [--trace-last=N] [--trace-pc=ini:fim] [--trace-every=k]]
+ *                [--record=log | --replay=log] [--emit-c=arq.c] [--debug]
+ *                [--listen=porta [--sessions=N]] [--stats-shm=nome]
+ *   ./simulador --batch manifesto [--jobs=N] [--results=arq] [--lanes] [opções de execução]
  *
- * Tamanhos: quase tudo 2 palavras; COPY = 3; STOP = 1.
+ * Os motores (--engine) e o verificador (--verify-only, --no-verify) estão
+ * descritos em sbvm.h e sbvm.cpp; a tradução para C (--emit-c), em
+ * sbvm_aot.cpp.
  *
- * Uso:
- *   gcc -O2 -std=c99 -o simulador simulator.c
- *   ./simulador programa.o2 [--trace] [--max-steps=N]
+ * O driver cuida das opções, do relatório de perfil, dos snapshots, do
+ * depurador (--debug), dos contadores ao vivo (--stats-shm), do servidor de
+ * sessões (--listen, sobre vm_sched_*) e do modo lote; a execução em si é
+ * sempre vm_run (ou vm_lanes_run, no lote com --lanes).
  */
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
-
-#define MEM_SIZE 65536
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sbvm.h"
+#include "object_image.h"
+#include "stats_shm.h"
+#include "trace_format.h"
 
 typedef struct
 {
-  int trace;
-  long long max_steps;
+  VmConfig vm;      // motor, limite de passos, fusão, verificação, --trace
+  int fusion_stats; // relatório das sequências fundidas ao final
+  int timing;       // tempos de início e de execução ao final (bench/run.sh)
+  int verify_only;  // só imprime o resultado da verificação
+  int interactive;  // esvazia a saída a cada OUTPUT
+  const char *input_file; // entrada do programa (mmap) no lugar do stdin
+  int jobs;               // --batch: threads de trabalho (0 = núcleos disponíveis)
+  const char *results;    // --batch: arquivo de resultados (NULL = stdout)
+  int lanes;              // --batch: motor em lanes para programas verificados
+  const char *profile;    // relatório de perfil (JSON) ao final
+  long long checkpoint_every; // passos entre snapshots (0 = desligado)
+  const char *checkpoint_dir;
+  const char *restore;        // snapshot de onde retomar
+  const char *trace_file;     // trace binário (trace_format.h)
+  long long trace_last;       // só os últimos N registros (0 = todos)
+  uint32_t trace_lo, trace_hi; // faixa de PCs registrada
+  long long trace_every;      // amostragem: um passo a cada k
+  const char *record;         // log das entradas lidas, para replay
+  const char *replay;         // roda com a entrada de um log e confere o resultado
+  const char *emit_c;         // só traduz o programa para C
+  int debug;                  // sessão interativa do depurador
+  int listen_port;            // --listen: uma sessão por conexão TCP (-1 = desligado)
+  long sessions;              // --listen: encerra depois de N sessões (0 = nunca)
+  const char *stats_shm;      // contadores ao vivo em memória compartilhada (stats_shm.h)
 } Options;
 
+/* Erros de carga e de uso: a execução em si reporta erros pelo Vm. */
 static void die(const char *m)
 {
   fprintf(stderr, "Erro: %s\n", m);
   exit(1);
 }
-static void usage(const char *a) { fprintf(stderr, "Uso: %s arquivo.o2 [--trace] [--max-steps=N]\n", a); }
+static void usage(const char *a)
+{
+  fprintf(stderr, "Uso: %s arquivo.o2 [--trace] [--max-steps=N] [--engine=threaded|switch|jit]\n"
+                  "       [--no-fusion] [--fusion-stats] [--timing] [--no-verify] [--verify-only]\n"
+                  "       [--interactive] [--input-file=arq] [--profile=arq.json]\n"
+                  "       [--checkpoint-every=N] [--checkpoint-dir=dir] [--restore=snapshot]\n"
+                  "       [--trace-file=arq.sbt [--trace-last=N] [--trace-pc=ini:fim] [--trace-every=k]]\n"
+                  "       [--record=log | --replay=log] [--emit-c=arq.c] [--debug]\n"
+                  "       [--listen=porta [--sessions=N]] [--stats-shm=nome]\n"
+                  "     %s --batch manifesto [--jobs=N] [--results=arq] [--lanes] [opções]\n",
+          a, a);
+}
 
-static int parse_options(int argc, char **argv, Options *opt)
+static int parse_options(int argc, char **argv, int first, Options *opt)
 {
-  opt->trace = 0;
-  opt->max_steps = 10000000LL; // 10 milhões
-  for (int i = 2; i < argc; ++i)
+  vm_config_default(&opt->vm);
+  opt->fusion_stats = 0;
+  opt->timing = 0;
+  opt->verify_only = 0;
+  opt->interactive = 0;
+  opt->input_file = NULL;
+  opt->jobs = 0;
+  opt->results = NULL;
+  opt->lanes = 0;
+  opt->profile = NULL;
+  opt->checkpoint_every = 0;
+  opt->checkpoint_dir = NULL; // padrão: diretório do --restore, ou "."
+  opt->restore = NULL;
+  opt->trace_file = NULL;
+  opt->trace_last = 0;
+  opt->trace_lo = 0;
+  opt->trace_hi = MEM_SIZE - 1;
+  opt->trace_every = 1;
+  opt->record = NULL;
+  opt->replay = NULL;
+  opt->emit_c = NULL;
+  opt->debug = 0;
+  opt->listen_port = -1;
+  opt->sessions = 0;
+  opt->stats_shm = NULL;
+  for (int i = first; i < argc; ++i)
   {
     if (!strcmp(argv[i], "--trace"))
-      opt->trace = 1;
+      opt->vm.trace = 1;
     else if (!strncmp(argv[i], "--max-steps=", 12))
     {
       char *end = NULL;
       long long v = strtoll(argv[i] + 12, &end, 10);
       if (!*(argv[i] + 12) || (end && *end) || v <= 0)
         return 0;
-      opt->max_steps = v;
+      opt->vm.max_steps = v;
+    }
+    else if (!strcmp(argv[i], "--engine=threaded"))
+      opt->vm.engine = ENGINE_THREADED;
+    else if (!strcmp(argv[i], "--engine=switch"))
+      opt->vm.engine = ENGINE_SWITCH;
+    else if (!strcmp(argv[i], "--engine=jit"))
+      opt->vm.engine = ENGINE_JIT;
+    else if (!strcmp(argv[i], "--no-fusion"))
+      opt->vm.fusion = 0;
+    else if (!strcmp(argv[i], "--fusion-stats"))
+      opt->fusion_stats = 1;
+    else if (!strcmp(argv[i], "--timing"))
+      opt->timing = 1;
+    else if (!strcmp(argv[i], "--no-verify"))
+      opt->vm.verify = 0;
+    else if (!strcmp(argv[i], "--verify-only"))
+      opt->verify_only = 1;
+    else if (!strcmp(argv[i], "--interactive"))
+      opt->interactive = 1;
+    else if (!strncmp(argv[i], "--input-file=", 13) && argv[i][13])
+      opt->input_file = argv[i] + 13;
+    else if (!strncmp(argv[i], "--jobs=", 7))
+    {
+      char *end = NULL;
+      long v = strtol(argv[i] + 7, &end, 10);
+      if (!argv[i][7] || *end || v <= 0 || v > 1024)
+        return 0;
+      opt->jobs = (int)v;
+    }
+    else if (!strncmp(argv[i], "--results=", 10) && argv[i][10])
+      opt->results = argv[i] + 10;
+    else if (!strcmp(argv[i], "--lanes"))
+      opt->lanes = 1;
+    else if (!strncmp(argv[i], "--profile=", 10) && argv[i][10])
+      opt->profile = argv[i] + 10;
+    else if (!strncmp(argv[i], "--checkpoint-every=", 19))
+    {
+      char *end = NULL;
+      long long v = strtoll(argv[i] + 19, &end, 10);
+      if (!argv[i][19] || *end || v <= 0)
+        return 0;
+      opt->checkpoint_every = v;
+    }
+    else if (!strncmp(argv[i], "--checkpoint-dir=", 17) && argv[i][17])
+      opt->checkpoint_dir = argv[i] + 17;
+    else if (!strncmp(argv[i], "--restore=", 10) && argv[i][10])
+      opt->restore = argv[i] + 10;
+    else if (!strncmp(argv[i], "--record=", 9) && argv[i][9])
+      opt->record = argv[i] + 9;
+    else if (!strncmp(argv[i], "--replay=", 9) && argv[i][9])
+      opt->replay = argv[i] + 9;
+    else if (!strncmp(argv[i], "--emit-c=", 9) && argv[i][9])
+      opt->emit_c = argv[i] + 9;
+    else if (!strcmp(argv[i], "--debug"))
+      opt->debug = 1;
+    else if (!strncmp(argv[i], "--stats-shm=", 12) && argv[i][12])
+      opt->stats_shm = argv[i] + 12;
+    else if (!strncmp(argv[i], "--listen=", 9))
+    {
+      char *end = NULL;
+      long v = strtol(argv[i] + 9, &end, 10);
+      if (!argv[i][9] || *end || v < 0 || v > 65535)
+        return 0;
+      opt->listen_port = (int)v;
+    }
+    else if (!strncmp(argv[i], "--sessions=", 11))
+    {
+      char *end = NULL;
+      long v = strtol(argv[i] + 11, &end, 10);
+      if (!argv[i][11] || *end || v <= 0)
+        return 0;
+      opt->sessions = v;
+    }
+    else if (!strncmp(argv[i], "--trace-file=", 13) && argv[i][13])
+      opt->trace_file = argv[i] + 13;
+    else if (!strncmp(argv[i], "--trace-last=", 13))
+    {
+      char *end = NULL;
+      long long v = strtoll(argv[i] + 13, &end, 10);
+      if (!argv[i][13] || *end || v <= 0)
+        return 0;
+      opt->trace_last = v;
+    }
+    else if (!strncmp(argv[i], "--trace-every=", 14))
+    {
+      char *end = NULL;
+      long long v = strtoll(argv[i] + 14, &end, 10);
+      if (!argv[i][14] || *end || v <= 0 || v > UINT32_MAX)
+        return 0;
+      opt->trace_every = v;
+    }
+    else if (!strncmp(argv[i], "--trace-pc=", 11))
+    {
+      unsigned lo, hi;
+      int used = 0;
+      if (sscanf(argv[i] + 11, "%u:%u%n", &lo, &hi, &used) != 2 || argv[i][11 + used] || lo > hi ||
+          hi >= MEM_SIZE)
+        return 0;
+      opt->trace_lo = lo;
+      opt->trace_hi = hi;
     }
     else
       return 0;
@@ -66,205 +242,1809 @@ static int parse_options(int argc, char **argv, Options *opt)
   return 1;
 }
 
-static int read_all_ints(const char *path, int32_t *mem, size_t *out_len)
+static void print_proof(const Proof *p, FILE *out)
 {
+  if (p->ok)
+  {
+    fprintf(out, "verificação: OK (%u instruções, %u palavras de código)\n", p->n_instr, p->n_code);
+    return;
+  }
+  fprintf(out, "verificação: FALHOU (%d problema(s))\n", p->n_reasons);
+  for (int i = 0; i < p->n_reasons && i < MAX_REASONS; ++i)
+    fprintf(out, "  %s\n", p->reasons[i]);
+  if (p->n_reasons > MAX_REASONS)
+    fprintf(out, "  ... mais %d\n", p->n_reasons - MAX_REASONS);
+}
+
+/*
+ * Relatório do perfil em JSON. Se existir o .map gerado pelo montador ao
+ * lado do programa (mesmo nome, extensão .map), cada PC é associado à
+ * linha do .pre que o gerou. Blocos básicos são reconstruídos a partir dos
+ * líderes do verificador e dos PCs executados; laços são os desvios para
+ * trás tomados, com o corpo indo do alvo até o desvio.
+ */
+#define PROFILE_TOP 10
+
+typedef struct
+{
+  int32_t line[MEM_SIZE]; // linha no .pre; 0 = sem informação
+  char *text[MEM_SIZE];   // texto da linha, no endereço inicial da instrução
+  int32_t start[MEM_SIZE];
+  char **sym_name;        // rótulos ("sym NOME ENDEREÇO"), em ordem de endereço
+  uint32_t *sym_addr;
+  size_t nsym;
+} LineMap;
+
+/* programa.o2 -> programa.map; NULL se não existe. */
+static LineMap *load_line_map(const char *program, char *path, size_t size)
+{
+  const char *dot = strrchr(program, '.');
+  const char *slash = strrchr(program, '/');
+  size_t base = dot && (!slash || dot > slash) ? (size_t)(dot - program) : strlen(program);
+  if (base + 5 > size)
+    return NULL;
+  memcpy(path, program, base);
+  strcpy(path + base, ".map");
   FILE *f = fopen(path, "r");
   if (!f)
+    return NULL;
+  LineMap *map = (LineMap *)calloc(1, sizeof(LineMap));
+  if (!map)
+  {
+    fclose(f);
+    return NULL;
+  }
+  char buf[1024];
+  while (fgets(buf, sizeof buf, f))
+  {
+    unsigned addr, words;
+    int line, used = 0;
+    char name[256];
+    if (!strncmp(buf, "sym ", 4))
+    {
+      if (sscanf(buf + 4, "%255s %u", name, &addr) != 2 || addr >= MEM_SIZE)
+        continue;
+      char **n = (char **)realloc(map->sym_name, (map->nsym + 1) * sizeof *n);
+      uint32_t *a = n ? (uint32_t *)realloc(map->sym_addr, (map->nsym + 1) * sizeof *a) : NULL;
+      if (n)
+        map->sym_name = n;
+      if (a)
+        map->sym_addr = a;
+      if (!n || !a || !(n[map->nsym] = strdup(name)))
+        continue;
+      a[map->nsym++] = addr;
+      continue;
+    }
+    if (buf[0] == ';' || sscanf(buf, "%u %u %d %n", &addr, &words, &line, &used) != 3)
+      continue;
+    char *text = buf + used;
+    text[strcspn(text, "\r\n")] = 0;
+    for (uint32_t k = addr; k < addr + words && k < MEM_SIZE; ++k)
+    {
+      map->line[k] = line;
+      map->start[k] = (int32_t)addr;
+    }
+    if (addr < MEM_SIZE && !map->text[addr])
+      map->text[addr] = strdup(text);
+  }
+  fclose(f);
+  return map;
+}
+
+static void free_line_map(LineMap *map)
+{
+  if (!map)
+    return;
+  for (uint32_t i = 0; i < MEM_SIZE; ++i)
+    free(map->text[i]);
+  for (size_t i = 0; i < map->nsym; ++i)
+    free(map->sym_name[i]);
+  free(map->sym_name);
+  free(map->sym_addr);
+  free(map);
+}
+
+static void json_string(FILE *out, const char *s)
+{
+  fputc('"', out);
+  for (; *s; ++s)
+  {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\')
+      fprintf(out, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(out, "\\u%04x", c);
+    else
+      fputc(c, out);
+  }
+  fputc('"', out);
+}
+
+/* ,"line":N,"source":"..." quando o mapa cobre o endereço */
+static void json_line(FILE *out, const LineMap *map, uint32_t pc)
+{
+  if (!map || pc >= MEM_SIZE || !map->line[pc])
+    return;
+  fprintf(out, ", \"line\": %d", map->line[pc]);
+  const char *text = map->text[map->start[pc]];
+  if (text)
+  {
+    fprintf(out, ", \"source\": ");
+    json_string(out, text);
+  }
+}
+
+typedef struct
+{
+  uint32_t start, end; // [start, end)
+  uint32_t n_instr;
+  uint64_t count;      // entradas no bloco
+  uint64_t steps;      // instruções executadas no bloco
+} ProfBlock;
+
+static int by_steps(const void *a, const void *b)
+{
+  uint64_t x = ((const ProfBlock *)a)->steps, y = ((const ProfBlock *)b)->steps;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+
+static int is_branch(int32_t op) { return isa_opcode(op) && isa_jumps(op); }
+
+static int write_profile(const Vm *vm, const char *path, const char *program, int status)
+{
+  const Profile *prof = vm->prof;
+  const int32_t *mem = vm->mem;
+  FILE *out = fopen(path, "w");
+  if (!out)
+  {
+    fprintf(stderr, "Não foi possível criar '%s'\n", path);
     return 0;
-  size_t i = 0;
-  while (1)
+  }
+  char map_path[4096];
+  LineMap *map = load_line_map(program, map_path, sizeof map_path);
+
+  fprintf(out, "{\n  \"program\": ");
+  json_string(out, program);
+  fprintf(out, ",\n  \"line_map\": ");
+  if (map)
+    json_string(out, map_path);
+  else
+    fprintf(out, "null");
+  fprintf(out, ",\n  \"status\": %d,\n  \"steps\": %lld,\n", status, vm->cpu.steps);
+  if (status)
   {
-    long long v;
-    int r = fscanf(f, "%lld", &v);
-    if (r == EOF)
-      break;
-    if (r != 1)
+    fprintf(out, "  \"error\": ");
+    json_string(out, vm->err);
+    fprintf(out, ",\n");
+  }
+
+  fprintf(out, "  \"opcodes\": {");
+  const char *sep = "";
+  for (int op = 0; op <= ISA_MAX_OPCODE; ++op)
+    if (prof->ops[op])
     {
-      int c = fgetc(f);
-      if (c == EOF)
-        break;
+      fprintf(out, "%s\"%s\": %llu", sep, ISA[op].mnemonic, (unsigned long long)prof->ops[op]);
+      sep = ", ";
+    }
+  fprintf(out, "},\n");
+
+  // opcodes de cada PC lidos da memória final
+  fprintf(out, "  \"instructions\": [");
+  sep = "\n";
+  for (uint32_t pc = 0; pc < MEM_SIZE; ++pc)
+  {
+    if (!prof->count[pc])
+      continue;
+    int32_t op = mem[pc];
+    fprintf(out, "%s    {\"pc\": %u, \"op\": \"%s\", \"count\": %llu", sep, pc,
+            ISA[isa_opcode(op) ? op : 0].mnemonic, (unsigned long long)prof->count[pc]);
+    json_line(out, map, pc);
+    fprintf(out, "}");
+    sep = ",\n";
+  }
+  fprintf(out, "\n  ],\n");
+
+  fprintf(out, "  \"branches\": [");
+  sep = "\n";
+  for (uint32_t pc = 0; pc < MEM_SIZE; ++pc)
+  {
+    if (!prof->count[pc] || !is_branch(mem[pc]) || isa_ends_flow(mem[pc]))
+      continue;
+    fprintf(out, "%s    {\"pc\": %u, \"op\": \"%s\", \"taken\": %llu, \"not_taken\": %llu", sep, pc,
+            ISA[mem[pc]].mnemonic, (unsigned long long)prof->taken[pc],
+            (unsigned long long)(prof->count[pc] - prof->taken[pc]));
+    json_line(out, map, pc);
+    fprintf(out, "}");
+    sep = ",\n";
+  }
+  fprintf(out, "\n  ],\n");
+
+  fprintf(out, "  \"memory\": [");
+  sep = "\n";
+  for (uint32_t a = 0; a < MEM_SIZE; ++a)
+  {
+    if (!prof->reads[a] && !prof->writes[a])
+      continue;
+    fprintf(out, "%s    {\"addr\": %u, \"reads\": %llu, \"writes\": %llu", sep, a,
+            (unsigned long long)prof->reads[a], (unsigned long long)prof->writes[a]);
+    json_line(out, map, a);
+    fprintf(out, "}");
+    sep = ",\n";
+  }
+  fprintf(out, "\n  ],\n");
+
+  // blocos: sequências de PCs executados, cortadas em líderes e desvios
+  size_t n_blocks = 0, cap_blocks = 64;
+  ProfBlock *blocks = (ProfBlock *)malloc(cap_blocks * sizeof(ProfBlock));
+  ProfBlock *cur = NULL;
+  uint32_t expect = 0;
+  for (uint32_t pc = 0; pc < MEM_SIZE && blocks; ++pc)
+  {
+    if (!prof->count[pc])
       continue;
-    } // ignora “lixo”
-    if (i >= MEM_SIZE)
+    int32_t op = mem[pc];
+    if (!cur || pc != expect || vm->img->leader[pc])
     {
-      fclose(f);
-      die("programa maior que MEM_SIZE");
+      if (n_blocks == cap_blocks)
+      {
+        cap_blocks *= 2;
+        ProfBlock *p = (ProfBlock *)realloc(blocks, cap_blocks * sizeof(ProfBlock));
+        if (!p)
+          break;
+        blocks = p;
+      }
+      cur = &blocks[n_blocks++];
+      cur->start = pc;
+      cur->n_instr = 0;
+      cur->count = prof->count[pc];
+      cur->steps = 0;
     }
-    mem[i++] = (int32_t)v;
+    expect = pc + (isa_opcode(op) ? op_size(op) : 1);
+    cur->end = expect;
+    ++cur->n_instr;
+    cur->steps += prof->count[pc];
+    if (!isa_opcode(op) || is_branch(op) || isa_stops(op))
+      cur = NULL;
+  }
+  if (blocks)
+    qsort(blocks, n_blocks, sizeof *blocks, by_steps);
+  fprintf(out, "  \"hot_blocks\": [");
+  sep = "\n";
+  for (size_t i = 0; blocks && i < n_blocks && i < PROFILE_TOP; ++i)
+  {
+    const ProfBlock *b = &blocks[i];
+    fprintf(out, "%s    {\"start\": %u, \"end\": %u, \"instructions\": %u, \"count\": %llu, \"steps\": %llu",
+            sep, b->start, b->end, b->n_instr, (unsigned long long)b->count, (unsigned long long)b->steps);
+    json_line(out, map, b->start);
+    fprintf(out, "}");
+    sep = ",\n";
+  }
+  fprintf(out, "\n  ],\n");
+
+  // laços: desvio para trás tomado; corpo = [alvo, desvio]
+  size_t n_loops = 0;
+  for (uint32_t pc = 0; pc < MEM_SIZE && blocks; ++pc)
+  {
+    if (!prof->taken[pc] || !is_branch(mem[pc]) || pc + 1 == MEM_SIZE || (uint32_t)mem[pc + 1] > pc)
+      continue;
+    uint32_t head = (uint32_t)mem[pc + 1];
+    uint64_t body = 0;
+    for (uint32_t k = head; k <= pc; ++k)
+      body += prof->count[k];
+    if (n_loops == cap_blocks)
+      break; // cabe: há no máximo um laço por bloco executado
+    blocks[n_loops].start = head;
+    blocks[n_loops].end = pc;
+    blocks[n_loops].count = prof->taken[pc];
+    blocks[n_loops].steps = body;
+    ++n_loops;
+  }
+  if (blocks)
+    qsort(blocks, n_loops, sizeof *blocks, by_steps);
+  fprintf(out, "  \"loops\": [");
+  sep = "\n";
+  for (size_t i = 0; blocks && i < n_loops && i < PROFILE_TOP; ++i)
+  {
+    const ProfBlock *b = &blocks[i];
+    fprintf(out, "%s    {\"head\": %u, \"back_edge\": %u, \"iterations\": %llu, \"steps\": %llu",
+            sep, b->start, b->end, (unsigned long long)b->count, (unsigned long long)b->steps);
+    json_line(out, map, b->start);
+    fprintf(out, "}");
+    sep = ",\n";
+  }
+  fprintf(out, "\n  ]\n}\n");
+
+  free(blocks);
+  free_line_map(map);
+  fclose(out);
+  return 1;
+}
+
+/*
+ * Snapshots (--checkpoint-every/--checkpoint-dir/--restore). O arquivo
+ * ckpt-NNNNNN.sbck guarda ACC, PC, passos, a posição na entrada e só as
+ * páginas de memória que mudaram desde o snapshot anterior (o primeiro é
+ * relativo à imagem carregada). Retomar do snapshot k aplica, em ordem, os
+ * snapshots 1..k do mesmo diretório sobre a imagem. Cada arquivo é gravado
+ * com outro nome e renomeado, para que um processo morto no meio não deixe
+ * um snapshot truncado.
+ */
+#define CKPT_MAGIC "SBCK"
+#define CKPT_VERSION 1
+#define CKPT_PAGE_WORDS 256
+#define CKPT_PAGES (MEM_SIZE / CKPT_PAGE_WORDS)
+
+typedef struct
+{
+  char magic[4];       // "SBCK"
+  uint16_t version;    // CKPT_VERSION
+  uint16_t page_words; // CKPT_PAGE_WORDS
+  uint32_t seq;        // 1, 2, ...
+  uint32_t image_sum;  // o2bChecksum da imagem carregada
+  uint32_t n_pages;    // registros {índice, palavras} que seguem
+  int32_t acc;
+  uint32_t pc;
+  uint32_t reserved;
+  int64_t steps;
+  uint64_t input_offset;
+} CkptHeader;
+
+static_assert(sizeof(CkptHeader) == 48, "CkptHeader não pode ter padding");
+
+typedef struct
+{
+  char dir[1024];
+  uint32_t seq;       // último snapshot gravado ou aplicado
+  uint32_t image_sum;
+  int32_t base[MEM_SIZE]; // memória no último snapshot
+} Checkpointer;
+
+static void ckpt_path(char *out, size_t size, const char *dir, uint32_t seq)
+{
+  snprintf(out, size, "%s/ckpt-%06u.sbck", dir, seq);
+}
+
+static int write_checkpoint(Checkpointer *ck, Vm *vm)
+{
+  char path[1100], tmp[1200];
+  ckpt_path(path, sizeof path, ck->dir, ck->seq + 1);
+  snprintf(tmp, sizeof tmp, "%s.tmp", path);
+  FILE *f = fopen(tmp, "wb");
+  if (!f)
+    return 0;
+  CkptHeader h;
+  memset(&h, 0, sizeof h);
+  memcpy(h.magic, CKPT_MAGIC, 4);
+  h.version = CKPT_VERSION;
+  h.page_words = CKPT_PAGE_WORDS;
+  h.seq = ck->seq + 1;
+  h.image_sum = ck->image_sum;
+  for (uint32_t p = 0; p < CKPT_PAGES; ++p)
+    if (memcmp(vm->mem + p * CKPT_PAGE_WORDS, ck->base + p * CKPT_PAGE_WORDS, 4 * CKPT_PAGE_WORDS))
+      ++h.n_pages;
+  h.acc = vm->cpu.ACC;
+  h.pc = vm->cpu.PC;
+  h.steps = vm->cpu.steps;
+  h.input_offset = io_offset(&vm->io);
+  int ok = fwrite(&h, sizeof h, 1, f) == 1;
+  for (uint32_t p = 0; p < CKPT_PAGES && ok; ++p)
+  {
+    int32_t *page = vm->mem + p * CKPT_PAGE_WORDS;
+    if (!memcmp(page, ck->base + p * CKPT_PAGE_WORDS, 4 * CKPT_PAGE_WORDS))
+      continue;
+    ok = fwrite(&p, 4, 1, f) == 1 && fwrite(page, 4, CKPT_PAGE_WORDS, f) == CKPT_PAGE_WORDS;
+    memcpy(ck->base + p * CKPT_PAGE_WORDS, page, 4 * CKPT_PAGE_WORDS);
+  }
+  if (fclose(f) != 0 || !ok || rename(tmp, path) != 0)
+  {
+    remove(tmp);
+    return 0;
+  }
+  ++ck->seq;
+  return 1;
+}
+
+/* Aplica um snapshot sobre vm->mem; devolve o cabeçalho em h. */
+static int apply_checkpoint(const char *path, Vm *vm, uint32_t seq, uint32_t image_sum, CkptHeader *h)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+  {
+    fprintf(stderr, "Não foi possível abrir '%s'\n", path);
+    return 0;
+  }
+  const char *why = NULL;
+  if (fread(h, sizeof *h, 1, f) != 1 || memcmp(h->magic, CKPT_MAGIC, 4) != 0 ||
+      h->version != CKPT_VERSION || h->page_words != CKPT_PAGE_WORDS || h->pc >= MEM_SIZE)
+    why = "snapshot corrompido ou de versão desconhecida";
+  else if (h->image_sum != image_sum)
+    why = "snapshot de outro programa";
+  else if (seq && h->seq != seq)
+    why = "sequência de snapshots incompleta";
+  for (uint32_t i = 0; !why && i < h->n_pages; ++i)
+  {
+    uint32_t p;
+    int32_t page[CKPT_PAGE_WORDS];
+    if (fread(&p, 4, 1, f) != 1 || p >= CKPT_PAGES || fread(page, 4, CKPT_PAGE_WORDS, f) != CKPT_PAGE_WORDS)
+      why = "snapshot truncado";
+    else
+      memcpy(vm->mem + p * CKPT_PAGE_WORDS, page, sizeof page);
   }
   fclose(f);
-  *out_len = i;
+  if (why)
+  {
+    fprintf(stderr, "Erro: %s: %s\n", path, why);
+    return 0;
+  }
   return 1;
 }
 
-int main(int argc, char **argv)
+/*
+ * Retoma do snapshot em path: lê o seu número de sequência e aplica
+ * 1..seq do mesmo diretório. Deixa vm->cpu e ck prontos para continuar e
+ * devolve a posição de entrada em *input_offset. Sem --checkpoint-dir, os
+ * novos snapshots continuam no diretório de path.
+ */
+static int restore_checkpoint(const char *path, const Options *opt, Vm *vm, Checkpointer *ck,
+                              uint64_t *input_offset)
 {
-  if (argc < 2)
+  CkptHeader h;
+  if (!apply_checkpoint(path, vm, 0, ck->image_sum, &h))
+    return 0;
+  vm_load(vm, vm->img); // o primeiro só foi lido para saber a sequência
+
+  char dir[1024];
+  const char *slash = strrchr(path, '/');
+  size_t len = slash ? (size_t)(slash - path) : 1;
+  if (len >= sizeof dir)
+    return 0;
+  memcpy(dir, slash ? path : ".", len);
+  dir[len] = 0;
+  if (!opt->checkpoint_dir)
+    strcpy(ck->dir, dir); // novos snapshots continuam a mesma cadeia
+  uint32_t last = h.seq;
+  for (uint32_t seq = 1; seq <= last; ++seq)
   {
-    usage(argv[0]);
-    return 1;
+    char p[1100];
+    ckpt_path(p, sizeof p, dir, seq);
+    if (!apply_checkpoint(seq == last ? path : p, vm, seq, ck->image_sum, &h))
+      return 0;
   }
-  Options opt;
-  if (!parse_options(argc, argv, &opt))
+  vm->cpu.ACC = h.acc;
+  vm->cpu.PC = h.pc;
+  vm->cpu.steps = h.steps;
+  ck->seq = last;
+  memcpy(ck->base, vm->mem, sizeof ck->base);
+  *input_offset = h.input_offset;
+  return 1;
+}
+
+/*
+ * Contadores ao vivo (--stats-shm, formato em stats_shm.h). Com eles a
+ * execução roda em fatias de uns STATS_SLICE passos e o segmento é
+ * atualizado em cada pausa. O histograma de opcodes é exato quando o
+ * motor threaded roda uma imagem verificada: ele conta as entradas em
+ * sequências lineares (vm_enable_op_counts) e a expansão em opcodes
+ * (vm_op_counts) é feita junto com a janela de passos/s. Nos outros casos
+ * os motores rodam sem instrumentação e o histograma é amostrado: uma
+ * amostra do opcode em PC por pausa, com fatias de tamanho sorteado para
+ * não entrar em fase com os laços do programa. Um INPUT bloqueado na
+ * entrada segura as atualizações até chegar o valor.
+ */
+#define STATS_SLICE 65536
+#define STATS_RATE_NS 500000000ull // janela mínima de passos/s
+
+typedef struct
+{
+  SbsStats *shm;
+  char name[256];
+  uint64_t rng;
+  uint64_t window_ns, window_steps; // início da janela de passos/s
+} Stats;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Cria o segmento "/name" do zero; um anterior com o mesmo nome fica só com quem já o mapeou. */
+static int stats_open(Stats *st, const char *name, const char *program, Vm *vm)
+{
+  snprintf(st->name, sizeof st->name, "%s%s", name[0] == '/' ? "" : "/", name);
+  shm_unlink(st->name);
+  int fd = shm_open(st->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+    return 0;
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, sizeof(SbsStats)) == 0)
+    p = mmap(NULL, sizeof(SbsStats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
   {
-    usage(argv[0]);
-    return 1;
+    shm_unlink(st->name);
+    return 0;
   }
+  SbsStats *s = st->shm = (SbsStats *)p;
+  st->window_ns = now_ns();
+  st->window_steps = (uint64_t)vm->cpu.steps;
+  st->rng = st->window_ns | 1;
+  SbsStats_begin(s);
+  memcpy(s->magic, SBS_MAGIC, 4);
+  s->version = SBS_VERSION;
+  s->size = sizeof(SbsStats);
+  s->pid = (uint32_t)getpid();
+  s->state = SBS_RUNNING;
+  snprintf(s->program, sizeof s->program, "%s", program);
+  s->start_ns = s->update_ns = st->window_ns;
+  s->steps = st->window_steps;
+  s->pc = vm->cpu.PC;
+  s->acc = vm->cpu.ACC;
+  s->op_source = vm_enable_op_counts(vm) ? SBS_OPS_COUNTED : SBS_OPS_SAMPLED;
+  SbsStats_end(s);
+  return 1;
+}
+
+/* Próxima fatia: STATS_SLICE passos em média. */
+static long long stats_slice(Stats *st)
+{
+  st->rng ^= st->rng << 13;
+  st->rng ^= st->rng >> 7;
+  st->rng ^= st->rng << 17;
+  return STATS_SLICE / 2 + (long long)(st->rng % STATS_SLICE);
+}
 
-  static int32_t mem[MEM_SIZE] = {0};
-  size_t n = 0;
-  if (!read_all_ints(argv[1], mem, &n))
+/* Publica o estado depois de um vm_run que devolveu rc. */
+static void stats_update(Stats *st, const Vm *vm, int rc)
+{
+  SbsStats *s = st->shm;
+  uint64_t t = now_ns();
+  uint64_t steps = (uint64_t)vm->cpu.steps;
+  uint32_t pc = vm->cpu.PC;
+  int counted = vm_op_counts(vm, NULL); // 0 a partir do primeiro vm_run em outro motor
+  SbsStats_begin(s);
+  s->update_ns = t;
+  s->steps = steps;
+  s->pc = pc;
+  s->acc = vm->cpu.ACC;
+  s->inputs = vm->io.n_in;
+  s->outputs = vm->io.n_out;
+  if (!counted && s->op_source == SBS_OPS_COUNTED)
   {
-    fprintf(stderr, "Não foi possível abrir '%s'\n", argv[1]);
-    return 1;
+    memset(s->ops, 0, sizeof s->ops);
+    s->op_source = SBS_OPS_SAMPLED;
   }
-  if (n == 0)
-    die("arquivo .o2 vazio.");
+  if (rc == VM_PAUSED && !counted)
+  {
+    int32_t op = pc < MEM_SIZE ? vm->mem[pc] : 0;
+    ++s->ops[isa_opcode(op) ? op : 0];
+    ++s->samples;
+  }
+  if (rc != VM_PAUSED)
+  {
+    s->state = SBS_DONE;
+    s->exit_status = rc;
+  }
+  if (t - st->window_ns >= STATS_RATE_NS || rc != VM_PAUSED)
+  {
+    if (t > st->window_ns)
+      s->steps_per_sec = (steps - st->window_steps) * 1000000000ull / (t - st->window_ns);
+    st->window_ns = t;
+    st->window_steps = steps;
+    if (counted)
+      vm_op_counts(vm, s->ops);
+  }
+  SbsStats_end(s);
+}
 
-  int32_t ACC = 0;
-  uint32_t PC = 0;
-  long long steps = 0;
+static void stats_close(Stats *st)
+{
+  munmap(st->shm, sizeof(SbsStats));
+  shm_unlink(st->name);
+}
 
+/*
+ * Roda até o fim em fatias: um snapshot a cada every passos (every > 0) e
+ * uma atualização de st (não nulo) em cada pausa.
+ */
+static int run_sliced(Vm *vm, Checkpointer *ck, long long every, Stats *st)
+{
   while (1)
   {
-    if (steps++ > opt.max_steps)
-      die("limite de passos excedido");
-    if (PC >= MEM_SIZE)
-      die("PC fora da memória");
-    int32_t op = mem[PC];
-    if (opt.trace)
-      fprintf(stderr, "[trace] PC=%u ACC=%d OPC=%d\n", PC, ACC, op);
-
-    switch (op)
-    {
-    case 1:
-    {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("ADD end");
-      ACC += mem[a];
-      PC += 2;
-      break;
-    } // ADD
-    case 2:
-    {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("SUB end");
-      ACC -= mem[a];
-      PC += 2;
-      break;
-    } // SUB
-    case 3:
-    {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("MUL end");
-      ACC *= mem[a];
-      PC += 2;
-      break;
-    } // MUL
-    case 4:
-    {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("DIV end");
-      if (mem[a] == 0)
-        die("DIV zero");
-      ACC /= mem[a];
-      PC += 2;
-      break;
-    } // DIV
-    case 5:
-    {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("JMP end");
-      PC = a;
-      break;
-    } // JMP
-    case 6:
-    {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("JMPN end");
-      PC = (ACC < 0) ? a : (PC + 2);
-      break;
-    } // JMPN
-    case 7:
-    {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("JMPP end");
-      PC = (ACC > 0) ? a : (PC + 2);
-      break;
-    } // JMPP
-    case 8:
+    // pausa quando vm->cpu.steps chegar ao próximo múltiplo de every
+    long long budget = every ? (vm->cpu.steps / every + 1) * every - vm->cpu.steps : 0;
+    if (st)
     {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("JMPZ end");
-      PC = (ACC == 0) ? a : (PC + 2);
-      break;
-    } // JMPZ
-    case 9:
-    {
-      uint32_t a = mem[PC + 1], b = mem[PC + 2];
-      if (a >= MEM_SIZE || b >= MEM_SIZE)
-        die("COPY end");
-      mem[b] = mem[a];
-      PC += 3;
-      break;
-    } // COPY
-    case 10:
-    {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("LOAD end");
-      ACC = mem[a];
-      PC += 2;
-      break;
-    } // LOAD
-    case 11:
-    {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("STORE end");
-      mem[a] = ACC;
-      PC += 2;
-      break;
-    } // STORE
-    case 12:
-    {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("INPUT end");
-      long long v;
-      if (scanf("%lld", &v) != 1)
-        die("INPUT falha");
-      mem[a] = (int32_t)v;
-      PC += 2;
-      break;
-    } // INPUT
-    case 13:
-    {
-      uint32_t a = mem[PC + 1];
-      if (a >= MEM_SIZE)
-        die("OUTPUT end");
-      printf("%d\n", mem[a]);
-      fflush(stdout);
-      PC += 2;
-      break;
-    } // OUTPUT
-    case 14:
+      long long b = stats_slice(st);
+      if (!budget || b < budget)
+        budget = b;
+    }
+    int rc = vm_run(vm, budget);
+    if (st)
+      stats_update(st, vm, rc);
+    if (rc != VM_PAUSED)
+      return rc;
+    if (!every || vm->cpu.steps % every)
+      continue;
+    io_flush(&vm->io); // a saída até aqui não se repete ao retomar
+    if (!write_checkpoint(ck, vm))
     {
-      return 0;
-    } // STOP
-    default:
+      fprintf(stderr, "Aviso: não foi possível gravar o snapshot %u em '%s'\n", ck->seq + 1, ck->dir);
+      every = 0;
+      if (!st)
+        return vm_run(vm, 0);
+    }
+  }
+}
+
+/*
+ * Gravação e replay (--record/--replay). O log guarda cada valor lido por
+ * INPUT junto com o passo em que foi lido e, ao final, o resumo da saída e
+ * o estado final. Tudo é varint (LEB128; valores com sinal em zigzag):
+ *
+ *   "SBRL" versão soma_da_imagem
+ *   {Δpasso valor}* 0         Δpasso >= 1 desde o INPUT anterior
+ *   status ACC PC passos n_saídas hash_saída hash_memória
+ *
+ * O replay tira a entrada do log, sem ler o stdin, exige que cada INPUT
+ * aconteça no mesmo passo da gravação e no fim confere a saída (contagem e
+ * FNV-1a dos valores) e o estado final.
+ */
+#define REPLAY_MAGIC "SBRL"
+#define REPLAY_VERSION 1
+
+typedef struct
+{
+  Io *io;                  // E/S padrão, para onde os valores são repassados
+  FILE *f;                 // --record: log em gravação
+  uint8_t *data;           // --replay: log inteiro
+  const uint8_t *p, *end;  // --replay: próximo byte ainda não lido
+  long long last_step;     // passo do INPUT anterior
+  uint64_t n_inputs;
+  uint64_t n_out;
+  uint32_t out_hash;
+  long long wrong_step;    // replay: passo de um INPUT fora do lugar (0 = nenhum)
+  long long logged_step;   // replay: passo gravado para esse INPUT
+} Replay;
+
+static void put_varint(FILE *f, uint64_t v)
+{
+  while (v >= 0x80)
+  {
+    putc((int)(v & 0x7F) | 0x80, f);
+    v >>= 7;
+  }
+  putc((int)v, f);
+}
+
+static void put_signed(FILE *f, long long v)
+{
+  put_varint(f, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+/* 0 se o log acaba no meio do número. */
+static int get_varint(Replay *r, uint64_t *out)
+{
+  uint64_t v = 0;
+  for (int shift = 0; r->p < r->end && shift < 64; shift += 7)
+  {
+    uint8_t b = *r->p++;
+    v |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
     {
-      fprintf(stderr, "Opcode desconhecido %d em PC=%u\n", op, PC);
+      *out = v;
       return 1;
     }
-    }
   }
+  return 0;
+}
+
+static int get_signed(Replay *r, long long *out)
+{
+  uint64_t v;
+  if (!get_varint(r, &v))
+    return 0;
+  *out = (long long)(v >> 1) ^ -(long long)(v & 1);
+  return 1;
+}
+
+static int record_input(void *ctx, long long step, long long *v)
+{
+  Replay *r = (Replay *)ctx;
+  int got = io_next_int(r->io, v);
+  if (got <= 0)
+    return got; // o fim da entrada não é gravado: no replay o log acaba no mesmo ponto
+  put_varint(r->f, (uint64_t)(step - r->last_step));
+  put_signed(r->f, *v);
+  r->last_step = step;
+  ++r->n_inputs;
+  return 1;
+}
+
+static int replay_input(void *ctx, long long step, long long *v)
+{
+  Replay *r = (Replay *)ctx;
+  const uint8_t *at = r->p;
+  uint64_t delta;
+  if (!get_varint(r, &delta) || delta == 0)
+  {
+    r->p = at; // fim das entradas gravadas: o resumo vem depois
+    return 0;
+  }
+  if (r->last_step + (long long)delta != step)
+  {
+    r->p = at;
+    r->wrong_step = step;
+    r->logged_step = r->last_step + (long long)delta;
+    return 0;
+  }
+  if (!get_signed(r, v))
+    return 0;
+  r->last_step = step;
+  ++r->n_inputs;
+  return 1;
+}
+
+static void replay_output(void *ctx, int32_t v)
+{
+  Replay *r = (Replay *)ctx;
+  uint32_t w = (uint32_t)v;
+  for (int b = 0; b < 4; ++b)
+  {
+    r->out_hash ^= (w >> (8 * b)) & 0xFF;
+    r->out_hash *= 16777619u;
+  }
+  ++r->n_out;
+  io_put_int(r->io, v);
+}
+
+static int record_open(Replay *r, const char *path, Vm *vm, uint32_t image_sum)
+{
+  memset(r, 0, sizeof *r);
+  if (!(r->f = fopen(path, "wb")))
+    return 0;
+  r->io = &vm->io;
+  r->out_hash = 2166136261u;
+  fwrite(REPLAY_MAGIC, 1, 4, r->f);
+  put_varint(r->f, REPLAY_VERSION);
+  put_varint(r->f, image_sum);
+  r->last_step = vm->cpu.steps;
+  vm_set_io(vm, record_input, replay_output, r);
+  return 1;
+}
+
+static int record_close(Replay *r, const Vm *vm, int status)
+{
+  put_varint(r->f, 0);
+  put_varint(r->f, (uint64_t)status);
+  put_signed(r->f, vm->cpu.ACC);
+  put_varint(r->f, vm->cpu.PC);
+  put_varint(r->f, (uint64_t)vm->cpu.steps);
+  put_varint(r->f, r->n_out);
+  put_varint(r->f, r->out_hash);
+  put_varint(r->f, o2bChecksum(vm->mem, MEM_SIZE));
+  int ok = !ferror(r->f);
+  return fclose(r->f) == 0 && ok;
+}
+
+/* Lê o log e confere o cabeçalho; mensagem de erro em *why. */
+static int replay_open(Replay *r, const char *path, Vm *vm, uint32_t image_sum, const char **why)
+{
+  memset(r, 0, sizeof *r);
+  *why = NULL;
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return 0;
+  size_t len = 0, cap = 1 << 16;
+  r->data = (uint8_t *)malloc(cap);
+  while (r->data)
+  {
+    len += fread(r->data + len, 1, cap - len, f);
+    if (len < cap)
+      break;
+    uint8_t *grown = (uint8_t *)realloc(r->data, cap *= 2);
+    if (!grown)
+      free(r->data);
+    r->data = grown;
+  }
+  fclose(f);
+  if (!r->data)
+  {
+    *why = "memória insuficiente";
+    return 0;
+  }
+  r->p = r->data + 4;
+  r->end = r->data + len;
+  uint64_t version, sum;
+  if (len < 4 || memcmp(r->data, REPLAY_MAGIC, 4) != 0 || !get_varint(r, &version) ||
+      version != REPLAY_VERSION || !get_varint(r, &sum))
+    *why = "log de replay corrompido ou de versão desconhecida";
+  else if (sum != image_sum)
+    *why = "log de replay de outro programa";
+  if (*why)
+  {
+    free(r->data);
+    return 0;
+  }
+  r->io = &vm->io;
+  r->out_hash = 2166136261u;
+  r->last_step = vm->cpu.steps;
+  vm_set_io(vm, replay_input, replay_output, r);
+  return 1;
+}
+
+/* Confere o fim da execução com o log; imprime as diferenças e devolve 0 se houver alguma. */
+static int replay_check(Replay *r, const Vm *vm, int status)
+{
+  int ok = 1;
+  if (r->wrong_step)
+  {
+    fprintf(stderr, "replay: INPUT no passo %lld, gravado no passo %lld\n", r->wrong_step, r->logged_step);
+    ok = 0;
+  }
+  uint64_t delta, left = 0;
+  long long v;
+  while (get_varint(r, &delta) && delta && get_signed(r, &v))
+    ++left;
+  if (left)
+  {
+    fprintf(stderr, "replay: o programa leu %llu entradas, o log tem %llu\n",
+            (unsigned long long)r->n_inputs, (unsigned long long)(r->n_inputs + left));
+    ok = 0;
+  }
+  uint64_t st, pc, steps, n_out, out_hash, mem_hash;
+  long long acc;
+  int same = 0;
+  if (!get_varint(r, &st) || !get_signed(r, &acc) || !get_varint(r, &pc) || !get_varint(r, &steps) ||
+      !get_varint(r, &n_out) || !get_varint(r, &out_hash) || !get_varint(r, &mem_hash))
+    fprintf(stderr, "replay: log truncado\n");
+  else if (st != (uint64_t)status)
+    fprintf(stderr, "replay: status %d, gravado %llu\n", status, (unsigned long long)st);
+  else if (acc != vm->cpu.ACC || pc != vm->cpu.PC || steps != (uint64_t)vm->cpu.steps)
+    fprintf(stderr, "replay: estado final ACC=%d PC=%u passos=%lld, gravado ACC=%lld PC=%llu passos=%llu\n",
+            vm->cpu.ACC, vm->cpu.PC, vm->cpu.steps, acc, (unsigned long long)pc, (unsigned long long)steps);
+  else if (n_out != r->n_out || out_hash != r->out_hash)
+    fprintf(stderr, "replay: saída difere (%llu valores, gravados %llu)\n", (unsigned long long)r->n_out,
+            (unsigned long long)n_out);
+  else if (mem_hash != o2bChecksum(vm->mem, MEM_SIZE))
+    fprintf(stderr, "replay: memória final difere\n");
+  else
+    same = 1;
+  ok = ok && same;
+  if (ok)
+    fprintf(stderr, "[replay] %llu entradas, %llu saídas e estado final conferem\n",
+            (unsigned long long)r->n_inputs, (unsigned long long)r->n_out);
+  free(r->data);
+  return ok;
+}
+
+/* Carrega e verifica o programa; NULL e a mensagem em err se não conseguiu. */
+static Image *open_program(const char *path, std::string &err)
+{
+  Image *img = image_new();
+  if (!img)
+  {
+    err = "Erro: memória insuficiente";
+    return NULL;
+  }
+  const char *why;
+  if (!image_load(img, path, &why))
+  {
+    err = why ? std::string("Erro: ") + why : "Não foi possível abrir '" + std::string(path) + "'";
+    image_free(img);
+    return NULL;
+  }
+  return img;
+}
+
+/* Como open_program, mas um erro de carga encerra o simulador. */
+static Image *load_program(const char *path)
+{
+  std::string err;
+  Image *img = open_program(path, err);
+  if (!img)
+  {
+    fprintf(stderr, "%s\n", err.c_str());
+    exit(1);
+  }
+  return img;
+}
+
+/*
+ * Modo lote: "simulador --batch manifesto". Cada linha do manifesto é
+ * "programa [entrada]" ('#' começa um comentário; sem entrada ou com
+ * "-", INPUT falha). Cada programa distinto é carregado e verificado uma
+ * vez; um programa que não carrega vira erro em cada um dos seus jobs, como
+ * uma entrada que não abre. Os jobs
+ * são distribuídos entre threads com uma fila por thread, e uma thread sem
+ * trabalho rouba do início da fila das outras. Cada thread reutiliza a
+ * mesma Vm entre jobs, com vm_reset quando o programa se repete. Os resultados saem na ordem do manifesto.
+ *
+ * Com --lanes, jobs seguidos do mesmo programa verificado rodam juntos no
+ * motor em lanes (vm_lanes_run), VM_LANES de cada vez; os resultados são
+ * os mesmos do motor escalar.
+ */
+typedef struct
+{
+  std::string program, input;
+  const Image *img;
+  int status;
+  long long steps;
+  std::string output, error;
+} BatchJob;
+
+typedef struct
+{
+  std::mutex lock;
+  std::deque<size_t> jobs;
+} WorkQueue;
+
+/* Próximo job: o mais recente da própria fila ou o mais antigo de outra. */
+static int take_job(std::vector<WorkQueue> &queues, size_t self, size_t *out)
+{
+  size_t n = queues.size();
+  for (size_t k = 0; k < n; ++k)
+  {
+    WorkQueue &q = queues[(self + k) % n];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.jobs.empty())
+      continue;
+    if (k == 0)
+    {
+      *out = q.jobs.back();
+      q.jobs.pop_back();
+    }
+    else
+    {
+      *out = q.jobs.front();
+      q.jobs.pop_front();
+    }
+    return 1;
+  }
+  return 0; // nenhum job é criado depois do início: todas as filas vazias = fim
+}
+
+/* --lanes: alimenta vm_lanes_run com os jobs da fila enquanto a imagem é a mesma. */
+typedef struct
+{
+  std::vector<BatchJob> *jobs;
+  std::vector<WorkQueue> *queues;
+  size_t self;
+  const Image *img;
+  long first;   // job que começou a rodada (-1 = já entregue)
+  long pending; // job de outra imagem tirado da fila (-1 = nenhum)
+} LaneFeed;
+
+typedef struct
+{
+  std::mutex lock;
+  long long group_steps, lane_steps, peeled;
+} LaneTotals;
+
+static long lane_next(void *ctx, Io *io)
+{
+  LaneFeed *f = (LaneFeed *)ctx;
+  while (1)
+  {
+    size_t i;
+    if (f->first >= 0)
+    {
+      i = (size_t)f->first;
+      f->first = -1;
+    }
+    else if (f->pending >= 0 || !take_job(*f->queues, f->self, &i))
+      return -1;
+    BatchJob &job = (*f->jobs)[i];
+    if (job.img != f->img)
+    {
+      f->pending = (long)i;
+      return -1;
+    }
+    if (!job.input.empty() && !io_open_input(io, job.input.c_str()))
+    {
+      job.status = 1;
+      job.steps = 0;
+      job.error = "Não foi possível abrir '" + job.input + "'";
+      continue;
+    }
+    return (long)i;
+  }
+}
+
+static void lane_done(void *ctx, long i, int status, long long steps, const char *err, Io *io)
+{
+  BatchJob &job = (*((LaneFeed *)ctx)->jobs)[i];
+  job.status = status;
+  job.steps = steps;
+  job.output.assign(io->cap ? io->cap : "", io->cap_len);
+  if (status)
+    job.error = err;
+}
+
+static void batch_worker(std::vector<BatchJob> &jobs, std::vector<WorkQueue> &queues,
+                         size_t self, const Options *opt, LaneTotals &totals)
+{
+  Vm *vm = vm_new(&opt->vm);
+  VmLanes *lanes = opt->lanes && !opt->vm.trace ? vm_lanes_new(&opt->vm) : NULL;
+  if (!vm || (opt->lanes && !opt->vm.trace && !lanes))
+    die("memória insuficiente");
+  const Image *last = NULL;
+  long pending = -1;
+  size_t i;
+  while (pending >= 0 || take_job(queues, self, &i))
+  {
+    if (pending >= 0)
+    {
+      i = (size_t)pending;
+      pending = -1;
+    }
+    BatchJob &job = jobs[i];
+    if (lanes && job.img->proof.ok)
+    {
+      LaneFeed feed = {&jobs, &queues, self, job.img, (long)i, -1};
+      vm_lanes_run(lanes, job.img, vm, lane_next, lane_done, &feed);
+      last = vm->img; // lanes que terminaram no motor escalar carregaram a imagem
+      pending = feed.pending;
+      continue;
+    }
+    if (job.img == last)
+      vm_reset(vm);
+    else
+      vm_load(vm, job.img);
+    last = job.img;
+    io_reset(&vm->io, -1, -1, 0);
+    if (!job.input.empty() && !io_open_input(&vm->io, job.input.c_str()))
+    {
+      job.status = 1;
+      job.steps = 0;
+      job.error = "Não foi possível abrir '" + job.input + "'";
+      continue;
+    }
+    job.status = vm_run(vm, 0);
+    io_flush(&vm->io);
+    job.steps = vm->cpu.steps;
+    job.output.assign(vm->io.cap ? vm->io.cap : "", vm->io.cap_len);
+    if (job.status)
+      job.error = vm->err;
+  }
+  if (lanes)
+  {
+    long long g, l, p;
+    vm_lanes_stats(lanes, &g, &l, &p);
+    std::lock_guard<std::mutex> guard(totals.lock);
+    totals.group_steps += g;
+    totals.lane_steps += l;
+    totals.peeled += p;
+    vm_lanes_free(lanes);
+  }
+  vm_free(vm);
+}
+
+static int read_manifest(const char *path, std::vector<BatchJob> &jobs)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return 0;
+  char line[4096];
+  while (fgets(line, sizeof line, f))
+  {
+    char *hash = strchr(line, '#');
+    if (hash)
+      *hash = 0;
+    const char *sep = " \t\r\n";
+    char *prog = strtok(line, sep);
+    if (!prog)
+      continue;
+    char *input = strtok(NULL, sep);
+    BatchJob job;
+    job.program = prog;
+    job.input = input && strcmp(input, "-") ? input : "";
+    job.img = NULL;
+    job.status = 0;
+    job.steps = 0;
+    jobs.push_back(job);
+  }
+  fclose(f);
+  return 1;
+}
+
+static int run_batch(const char *manifest, const Options *opt)
+{
+  std::vector<BatchJob> jobs;
+  if (!read_manifest(manifest, jobs))
+  {
+    fprintf(stderr, "Não foi possível abrir '%s'\n", manifest);
+    return 1;
+  }
+
+  std::map<std::string, Image *> images;
+  std::map<std::string, std::string> load_errors;
+  size_t runnable = 0;
+  for (size_t i = 0; i < jobs.size(); ++i)
+  {
+    const std::string &prog = jobs[i].program;
+    if (!images.count(prog))
+    {
+      std::string err;
+      images[prog] = open_program(prog.c_str(), err);
+      if (!images[prog])
+        load_errors[prog] = err;
+    }
+    jobs[i].img = images[prog];
+    if (!jobs[i].img)
+    {
+      jobs[i].status = 1;
+      jobs[i].error = load_errors[prog];
+    }
+    else
+      ++runnable;
+  }
+
+  size_t nthreads = opt->jobs > 0 ? (size_t)opt->jobs : std::thread::hardware_concurrency();
+  if (nthreads == 0)
+    nthreads = 1;
+  if (nthreads > runnable)
+    nthreads = runnable ? runnable : 1;
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  std::vector<WorkQueue> queues(nthreads);
+  LaneTotals totals;
+  totals.group_steps = totals.lane_steps = totals.peeled = 0;
+  size_t queued = 0;
+  for (size_t i = 0; i < jobs.size(); ++i)
+    if (jobs[i].img)
+      queues[queued++ % nthreads].jobs.push_back(i);
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < nthreads; ++t)
+    workers.push_back(std::thread(batch_worker, std::ref(jobs), std::ref(queues), t, opt, std::ref(totals)));
+  batch_worker(jobs, queues, 0, opt, totals);
+  for (size_t t = 0; t < workers.size(); ++t)
+    workers[t].join();
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  FILE *out = opt->results ? fopen(opt->results, "w") : stdout;
+  if (!out)
+  {
+    fprintf(stderr, "Não foi possível criar '%s'\n", opt->results);
+    return 1;
+  }
+  size_t failed = 0;
+  for (size_t i = 0; i < jobs.size(); ++i)
+  {
+    const BatchJob &job = jobs[i];
+    size_t lines = 0;
+    for (size_t k = 0; k < job.output.size(); ++k)
+      lines += job.output[k] == '\n';
+    fprintf(out, "job %zu %s %s\n", i + 1, job.program.c_str(), job.input.empty() ? "-" : job.input.c_str());
+    fprintf(out, "status %d\nsteps %lld\n", job.status, job.steps);
+    if (job.status)
+    {
+      fprintf(out, "error %s\n", job.error.c_str());
+      ++failed;
+    }
+    fprintf(out, "output %zu\n", lines);
+    fwrite(job.output.data(), 1, job.output.size(), out);
+  }
+  if (out != stdout)
+    fclose(out);
+
+  double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+  fprintf(stderr, "[lote] %zu jobs (%zu com erro) em %zu threads, %.3f s\n",
+          jobs.size(), failed, nthreads, secs);
+  if (totals.group_steps)
+    fprintf(stderr, "[lanes] %.2f de %d lanes ocupados em média, %lld jobs terminados no motor escalar\n",
+            (double)totals.lane_steps / totals.group_steps, VM_LANES, totals.peeled);
+  for (std::map<std::string, Image *>::iterator it = images.begin(); it != images.end(); ++it)
+    image_free(it->second);
+  return failed ? 1 : 0;
+}
+
+/*
+ * Depurador (--debug). Os comandos vêm do stdin, um por linha; ALVO é um
+ * endereço, um rótulo do .map (sem diferenciar maiúsculas) ou RÓTULO+N.
+ * Breakpoints e watchpoints ficam na Vm (vm_break/vm_watch): entre duas
+ * paradas o motor roda sem checagem nenhuma por passo. Sem --input-file, o
+ * INPUT do programa pede o valor no próprio terminal.
+ */
+#define DEBUG_HELP                                                          \
+  "  b ALVO          breakpoint            d ALVO    remove o breakpoint\n"  \
+  "  w ALVO          watchpoint de escrita dw ALVO   remove o watchpoint\n"  \
+  "  s [N]           executa N instruções  c         continua\n"             \
+  "  p               PC, ACC e instrução   p ALVO [N] N palavras da memória\n" \
+  "  l               lista breakpoints e watchpoints\n"                      \
+  "  r               reinicia o programa   q         sai\n"
+
+typedef struct
+{
+  Vm *vm;
+  const Image *img;
+  const LineMap *map; // NULL: sem .map, só endereços
+  const char *input_file;
+  std::map<uint32_t, int32_t> watches; // endereço -> último valor visto
+  int done;                            // STOP ou erro: só r retoma
+  int status;                          // resultado do último vm_run
+} Debugger;
+
+static int debug_input(void *ctx, long long step, long long *value)
+{
+  (void)step;
+  Debugger *d = (Debugger *)ctx;
+  char line[128];
+  io_flush(&d->vm->io);
+  for (;;)
+  {
+    fputs("INPUT> ", stdout);
+    fflush(stdout);
+    if (!fgets(line, sizeof line, stdin))
+      return 0;
+    char *end;
+    long long v = strtoll(line, &end, 10);
+    while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n')
+      ++end;
+    if (end != line && !*end)
+    {
+      *value = v;
+      return 1;
+    }
+    fputs("valor inválido\n", stdout);
+  }
+}
+
+/* ALVO -> endereço; 0 se não é número nem rótulo conhecido, ou sai da memória. */
+static int debug_target(const Debugger *d, const char *s, uint32_t *out)
+{
+  char *end;
+  long long addr;
+  if (isdigit((unsigned char)*s))
+    addr = strtoll(s, &end, 10);
+  else
+  {
+    const char *plus = strchr(s, '+');
+    size_t len = plus ? (size_t)(plus - s) : strlen(s);
+    long long off = 0;
+    if (plus && (!plus[1] || (off = strtoll(plus + 1, &end, 10), *end)))
+      return 0;
+    size_t i = 0;
+    while (d->map && i < d->map->nsym &&
+           (strlen(d->map->sym_name[i]) != len || strncasecmp(d->map->sym_name[i], s, len)))
+      ++i;
+    if (!d->map || i == d->map->nsym)
+      return 0;
+    addr = (long long)d->map->sym_addr[i] + off;
+    end = (char *)"";
+  }
+  if (*end || addr < 0 || addr >= MEM_SIZE)
+    return 0;
+  *out = (uint32_t)addr;
+  return 1;
+}
+
+/* " (RÓTULO+k)" do último rótulo em ou antes de addr; vazio sem rótulo. */
+static void debug_where(const Debugger *d, uint32_t addr, char *out, size_t size)
+{
+  size_t best = 0;
+  int found = 0;
+  for (size_t i = 0; d->map && i < d->map->nsym && d->map->sym_addr[i] <= addr; ++i)
+    if (!found || d->map->sym_addr[i] != d->map->sym_addr[best])
+    {
+      best = i;
+      found = 1;
+    }
+  if (!found)
+    *out = 0;
+  else if (d->map->sym_addr[best] == addr)
+    snprintf(out, size, " (%s)", d->map->sym_name[best]);
+  else
+    snprintf(out, size, " (%s+%u)", d->map->sym_name[best], addr - d->map->sym_addr[best]);
+}
+
+static void debug_show(const Debugger *d)
+{
+  const Cpu *c = &d->vm->cpu;
+  const int32_t *mem = d->vm->mem;
+  char where[300];
+  debug_where(d, c->PC, where, sizeof where);
+  printf("PC=%u%s  ACC=%d  passos=%lld", c->PC, where, c->ACC, c->steps);
+  if (c->PC < MEM_SIZE)
+  {
+    int32_t op = mem[c->PC];
+    if (isa_opcode(op))
+    {
+      printf("  %s", ISA[op].mnemonic);
+      for (int k = 1; k < op_size(op) && c->PC + k < MEM_SIZE; ++k)
+        printf(" %d", mem[c->PC + k]);
+    }
+    else
+      printf("  (opcode %d)", op);
+    if (d->map && d->map->line[c->PC])
+      printf("    ; linha %d: %s", d->map->line[c->PC],
+             d->map->text[d->map->start[c->PC]] ? d->map->text[d->map->start[c->PC]] : "");
+  }
+  putchar('\n');
+}
+
+/* Volta ao início do programa; breakpoints e watchpoints continuam. */
+static int debug_restart(Debugger *d)
+{
+  vm_load(d->vm, d->img);
+  io_reset(&d->vm->io, 1, -1, 1);
+  if (d->input_file && !io_open_input(&d->vm->io, d->input_file))
+  {
+    fprintf(stderr, "Não foi possível abrir '%s'\n", d->input_file);
+    return 0;
+  }
+  vm_set_io(d->vm, d->input_file ? NULL : debug_input, NULL, d);
+  for (std::map<uint32_t, int32_t>::iterator it = d->watches.begin(); it != d->watches.end(); ++it)
+    it->second = d->vm->mem[it->first];
+  d->done = 0;
+  d->status = 0;
+  return 1;
+}
+
+static void debug_run(Debugger *d, long long budget)
+{
+  if (d->done)
+  {
+    puts("o programa terminou; r reinicia");
+    return;
+  }
+  fflush(stdout);
+  int rc = vm_run(d->vm, budget);
+  io_flush(&d->vm->io);
+  d->status = rc;
+  if (rc == 0)
+  {
+    printf("STOP após %lld passos\n", d->vm->cpu.steps);
+    d->done = 1;
+    return;
+  }
+  if (rc == 1)
+  {
+    printf("%s\n", d->vm->err);
+    d->done = 1;
+  }
+  else if (rc == VM_BREAK)
+    fputs("breakpoint: ", stdout);
+  else if (rc == VM_WATCH)
+  {
+    uint32_t a = d->vm->watch_hit;
+    char where[300];
+    debug_where(d, a, where, sizeof where);
+    printf("watchpoint: mem[%u]%s era %d, agora %d\n", a, where, d->watches[a], d->vm->mem[a]);
+    d->watches[a] = d->vm->mem[a];
+  }
+  debug_show(d);
+}
+
+static int run_debug(Vm *vm, const Image *img, const Options *opt, const char *program)
+{
+  char map_path[4096];
+  Debugger d;
+  d.vm = vm;
+  d.img = img;
+  d.map = load_line_map(program, map_path, sizeof map_path);
+  d.input_file = opt->input_file;
+  if (!debug_restart(&d))
+    return 1;
+  printf("%s: %zu palavras, %s, %zu rótulos; h lista os comandos\n", program, img->n,
+         vm->verified ? "verificado" : "não verificado", d.map ? d.map->nsym : (size_t)0);
+  debug_show(&d);
+
+  char line[512];
+  for (;;)
+  {
+    fputs("(sbdb) ", stdout);
+    fflush(stdout);
+    if (!fgets(line, sizeof line, stdin))
+      break;
+    char cmd[8], a1[256], a2[32];
+    int n = sscanf(line, "%7s %255s %31s", cmd, a1, a2);
+    if (n <= 0)
+      continue;
+    uint32_t addr;
+    int has_addr = n >= 2 && debug_target(&d, a1, &addr);
+    if (n >= 2 && !has_addr && strcmp(cmd, "s"))
+    {
+      printf("alvo inválido: '%s'\n", a1);
+      continue;
+    }
+    if (!strcmp(cmd, "q"))
+      break;
+    else if (!strcmp(cmd, "h"))
+      fputs(DEBUG_HELP, stdout);
+    else if (!strcmp(cmd, "b") || !strcmp(cmd, "d"))
+    {
+      int on = cmd[0] == 'b';
+      if (!has_addr)
+        puts("uso: b ALVO / d ALVO");
+      else if (!vm_break(vm, addr, on))
+        puts("Erro: memória insuficiente");
+      else
+      {
+        char where[300];
+        debug_where(&d, addr, where, sizeof where);
+        printf("breakpoint em %u%s %s\n", addr, where, on ? "ligado" : "removido");
+      }
+    }
+    else if (!strcmp(cmd, "w") || !strcmp(cmd, "dw"))
+    {
+      int on = cmd[0] == 'w';
+      if (!has_addr)
+        puts("uso: w ALVO / dw ALVO");
+      else if (!vm_watch(vm, addr, on))
+        puts("Erro: memória insuficiente");
+      else
+      {
+        char where[300];
+        debug_where(&d, addr, where, sizeof where);
+        if (on)
+          d.watches[addr] = vm->mem[addr];
+        else
+          d.watches.erase(addr);
+        printf("watchpoint em mem[%u]%s %s\n", addr, where, on ? "ligado" : "removido");
+      }
+    }
+    else if (!strcmp(cmd, "s"))
+    {
+      char *end;
+      long long k = n >= 2 ? strtoll(a1, &end, 10) : 1;
+      if (n >= 2 && (*end || k <= 0))
+        puts("uso: s [N]");
+      else
+        debug_run(&d, k);
+    }
+    else if (!strcmp(cmd, "c"))
+      debug_run(&d, 0);
+    else if (!strcmp(cmd, "p"))
+    {
+      char *end = NULL;
+      long long k = n >= 3 ? strtoll(a2, &end, 10) : 1;
+      if (n == 1)
+        debug_show(&d);
+      else if ((end && *end) || k <= 0)
+        puts("uso: p [ALVO [N]]");
+      else
+        for (uint32_t a = addr; a < MEM_SIZE && a - addr < (uint64_t)k; ++a)
+        {
+          char where[300];
+          debug_where(&d, a, where, sizeof where);
+          printf("mem[%u]%s = %d\n", a, where, vm->mem[a]);
+        }
+    }
+    else if (!strcmp(cmd, "l"))
+    {
+      char where[300];
+      for (uint32_t a = 0; vm->brk && a < MEM_SIZE; ++a)
+        if (vm->brk[a])
+        {
+          debug_where(&d, a, where, sizeof where);
+          printf("breakpoint %u%s\n", a, where);
+        }
+      for (std::map<uint32_t, int32_t>::iterator it = d.watches.begin(); it != d.watches.end(); ++it)
+      {
+        debug_where(&d, it->first, where, sizeof where);
+        printf("watchpoint mem[%u]%s = %d\n", it->first, where, vm->mem[it->first]);
+      }
+    }
+    else if (!strcmp(cmd, "r"))
+    {
+      if (!debug_restart(&d))
+        break;
+      debug_show(&d);
+    }
+    else
+      puts("comando desconhecido; h lista os comandos");
+  }
+  free_line_map((LineMap *)d.map);
+  return d.done && d.status ? 1 : 0;
+}
+
+/*
+ * --listen: cada conexão TCP (só 127.0.0.1) é uma sessão do programa, com
+ * o socket como entrada e saída. Todas as sessões rodam em uma thread só,
+ * no escalonador de libsbvm (vm_sched_*): uma sessão esperando INPUT não
+ * ocupa nada além da Vm. As Vms de sessões terminadas são reaproveitadas
+ * com vm_reset. Erros em execução vão para o cliente e para o stderr.
+ */
+#define LISTEN_SLICE 65536 // instruções por vez de uma sessão que só calcula
+
+typedef struct
+{
+  const Image *img;
+  const VmConfig *cfg;
+  VmSched *sched;
+  std::vector<Vm *> idle; // Vms livres, com a imagem carregada
+  long started, finished, limit;
+  int failed;
+} Server;
+
+typedef struct
+{
+  int fd;
+  long id; // ordem de chegada, para o log
+} Client;
+
+static void listen_done(void *ctx, Vm *vm, int status, void *user)
+{
+  Server *srv = (Server *)ctx;
+  Client *c = (Client *)user;
+  int fd = c->fd;
+  if (status == 1)
+  {
+    // melhor esforço: o cliente pode já ter ido embora
+    char line[sizeof vm->err + 1];
+    int n = snprintf(line, sizeof line, "%s\n", vm->err);
+    if (write(fd, line, (size_t)n) < 0)
+      n = 0;
+    ++srv->failed;
+  }
+  close(fd);
+  ++srv->finished;
+  fprintf(stderr, "[sessão %ld] %s, %lld passos\n", c->id, status ? vm->err : "STOP", vm->cpu.steps);
+  delete c;
+  vm_reset(vm);
+  srv->idle.push_back(vm);
+}
+
+static void listen_accept(void *ctx, int lfd)
+{
+  Server *srv = (Server *)ctx;
+  while (!srv->limit || srv->started < srv->limit)
+  {
+    int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        perror("accept");
+      return;
+    }
+    Vm *vm = NULL;
+    if (!srv->idle.empty())
+    {
+      vm = srv->idle.back();
+      srv->idle.pop_back();
+    }
+    else if ((vm = vm_new(srv->cfg)))
+      vm_load(vm, srv->img);
+    Client *c = vm ? new Client : NULL;
+    if (c)
+    {
+      c->fd = fd;
+      c->id = srv->started + 1;
+    }
+    if (!c || !vm_sched_add(srv->sched, vm, fd, fd, c))
+    {
+      fprintf(stderr, "Erro: memória insuficiente para mais uma sessão\n");
+      if (vm)
+        srv->idle.push_back(vm);
+      delete c;
+      close(fd);
+      continue;
+    }
+    ++srv->started;
+  }
+}
+
+static int run_listen(const Image *img, const Options *opt)
+{
+  signal(SIGPIPE, SIG_IGN); // cliente que fecha a conexão vira EPIPE, não sinal
+  struct rlimit rl;         // uma sessão por descritor
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+  {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+  int lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int one = 1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons((uint16_t)opt->listen_port);
+  socklen_t len = sizeof addr;
+  if (lfd < 0 || setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one) < 0 ||
+      bind(lfd, (struct sockaddr *)&addr, sizeof addr) < 0 || listen(lfd, SOMAXCONN) < 0 ||
+      getsockname(lfd, (struct sockaddr *)&addr, &len) < 0)
+  {
+    fprintf(stderr, "Erro: não foi possível escutar na porta %d: %s\n", opt->listen_port, strerror(errno));
+    return 1;
+  }
+
+  Server srv;
+  srv.img = img;
+  srv.cfg = &opt->vm;
+  srv.started = srv.finished = 0;
+  srv.limit = opt->sessions;
+  srv.failed = 0;
+  srv.sched = vm_sched_new(LISTEN_SLICE, listen_done, &srv);
+  if (!srv.sched || !vm_sched_watch(srv.sched, lfd, listen_accept, &srv))
+    die("não foi possível criar o epoll");
+  // a porta de verdade, para --listen=0
+  fprintf(stderr, "[listen] 127.0.0.1:%d\n", ntohs(addr.sin_port));
+
+  while (!srv.limit || srv.finished < srv.limit)
+    if (vm_sched_run(srv.sched, -1) < 0)
+    {
+      perror("epoll_wait");
+      break;
+    }
+  vm_sched_free(srv.sched);
+  close(lfd);
+  for (size_t i = 0; i < srv.idle.size(); ++i)
+    vm_free(srv.idle[i]);
+  fprintf(stderr, "[listen] %ld sessões, %d com erro\n", srv.finished, srv.failed);
+  return srv.failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t t_start = now_ns();
+  Options opt;
+  if (argc >= 2 && !strcmp(argv[1], "--batch"))
+  {
+    if (argc < 3 || !parse_options(argc, argv, 3, &opt) || opt.profile || opt.checkpoint_every ||
+        opt.restore || opt.trace_file || opt.record || opt.replay || opt.emit_c || opt.debug ||
+        opt.listen_port >= 0 || opt.sessions || opt.stats_shm || opt.timing)
+    {
+      usage(argv[0]);
+      return 1;
+    }
+    return run_batch(argv[2], &opt);
+  }
+  // o log conta os passos desde o início e substitui a entrada inteira
+  if (argc < 2 || !parse_options(argc, argv, 2, &opt) || (opt.record && opt.replay) ||
+      ((opt.record || opt.replay) && opt.restore) || (opt.replay && opt.input_file) ||
+      ((opt.debug || opt.listen_port >= 0) &&
+       (opt.vm.trace || opt.profile || opt.checkpoint_every || opt.restore || opt.trace_file || opt.record ||
+        opt.replay || opt.emit_c || opt.stats_shm || opt.timing)) ||
+      (opt.listen_port >= 0 && (opt.debug || opt.input_file || opt.interactive)) ||
+      (opt.sessions && opt.listen_port < 0))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  if (opt.trace_file && MEM_SIZE - 1 > SBT_MAX_PC)
+    die("--trace-file guarda PCs de 16 bits e não funciona com MEM_SIZE > 65536");
+
+  Image *img = load_program(argv[1]);
+  if (opt.verify_only)
+  {
+    print_proof(&img->proof, stdout);
+    if (img->code_end)
+      printf("fronteira código/dados declarada: %u\n", img->code_end);
+    return img->proof.ok ? 0 : 1;
+  }
+  if (opt.emit_c)
+  {
+    if (!img->proof.ok)
+    {
+      print_proof(&img->proof, stderr);
+      die("--emit-c só traduz programas verificados");
+    }
+    FILE *out = fopen(opt.emit_c, "w");
+    if (!out)
+    {
+      fprintf(stderr, "Não foi possível criar '%s'\n", opt.emit_c);
+      return 1;
+    }
+    int ok = image_emit_c(img, out, argv[1], opt.vm.max_steps);
+    if (fclose(out) != 0 || !ok)
+      die("não foi possível gravar o programa C");
+    image_free(img);
+    return 0;
+  }
+
+  if (opt.listen_port >= 0)
+  {
+    int rc = run_listen(img, &opt);
+    image_free(img);
+    return rc;
+  }
+
+  Vm *vm = vm_new(&opt.vm);
+  if (!vm || (opt.profile && !vm_enable_profile(vm)))
+    die("memória insuficiente");
+  if (opt.debug)
+  {
+    int rc = run_debug(vm, img, &opt, argv[1]);
+    vm_free(vm);
+    image_free(img);
+    return rc;
+  }
+  vm_load(vm, img);
+  io_reset(&vm->io, 1, 0, opt.interactive || opt.vm.trace);
+  if (opt.input_file && !io_open_input(&vm->io, opt.input_file))
+  {
+    fprintf(stderr, "Não foi possível abrir '%s'\n", opt.input_file);
+    return 1;
+  }
+
+  Checkpointer *ck = NULL;
+  if (opt.checkpoint_every || opt.restore)
+  {
+    if (!(ck = (Checkpointer *)malloc(sizeof(Checkpointer))))
+      die("memória insuficiente");
+    snprintf(ck->dir, sizeof ck->dir, "%s", opt.checkpoint_dir ? opt.checkpoint_dir : ".");
+    ck->seq = 0;
+    ck->image_sum = o2bChecksum(img->words, MEM_SIZE);
+    memcpy(ck->base, vm->mem, sizeof ck->base);
+  }
+  if (opt.restore)
+  {
+    uint64_t offset;
+    if (!restore_checkpoint(opt.restore, &opt, vm, ck, &offset))
+      return 1;
+    if (!io_skip(&vm->io, offset))
+      die("entrada menor que a posição gravada no snapshot");
+  }
+  Replay rp;
+  if (opt.record && !record_open(&rp, opt.record, vm, o2bChecksum(img->words, MEM_SIZE)))
+  {
+    fprintf(stderr, "Não foi possível criar '%s'\n", opt.record);
+    return 1;
+  }
+  if (opt.replay)
+  {
+    const char *why;
+    if (!replay_open(&rp, opt.replay, vm, o2bChecksum(img->words, MEM_SIZE), &why))
+    {
+      if (why)
+        die(why);
+      fprintf(stderr, "Não foi possível abrir '%s'\n", opt.replay);
+      return 1;
+    }
+  }
+  if (opt.trace_file &&
+      !vm_trace_open(vm, opt.trace_file, opt.trace_last, opt.trace_lo, opt.trace_hi, opt.trace_every))
+  {
+    fprintf(stderr, "Não foi possível criar '%s'\n", opt.trace_file);
+    return 1;
+  }
+  Stats stats;
+  if (opt.stats_shm && !stats_open(&stats, opt.stats_shm, argv[1], vm))
+  {
+    fprintf(stderr, "Não foi possível criar o segmento de memória compartilhada '%s'\n", opt.stats_shm);
+    return 1;
+  }
+  uint64_t t_run = now_ns();
+  long long first_step = vm->cpu.steps;
+  int rc = opt.checkpoint_every || opt.stats_shm
+               ? run_sliced(vm, ck, opt.checkpoint_every, opt.stats_shm ? &stats : NULL)
+               : vm_run(vm, 0);
+  uint64_t t_end = now_ns();
+  if (opt.stats_shm)
+    stats_close(&stats);
+  free(ck);
+  vm_trace_close(vm);
+  io_flush(&vm->io);
+  if (rc)
+    fprintf(stderr, "%s\n", vm->err);
+  if (opt.record && !record_close(&rp, vm, rc))
+  {
+    fprintf(stderr, "Erro: não foi possível gravar '%s'\n", opt.record);
+    rc = 1;
+  }
+  if (opt.replay && !replay_check(&rp, vm, rc))
+    rc = 1;
+  if (opt.fusion_stats)
+    vm_print_fusion_stats(vm, stderr);
+  if (opt.timing)
+  {
+    // início: do main até o primeiro vm_run (carga, verificação, preparação da Vm)
+    long long steps = vm->cpu.steps - first_step;
+    double run_ms = (double)(t_end - t_run) / 1e6;
+    fprintf(stderr, "[timing] início %.3f ms, execução %.3f ms, %lld passos, %.3f ns/passo\n",
+            (double)(t_run - t_start) / 1e6, run_ms, steps, steps ? run_ms * 1e6 / (double)steps : 0.0);
+  }
+  if (opt.profile && !write_profile(vm, opt.profile, argv[1], rc))
+    rc = 1;
+  vm_free(vm);
+  image_free(img);
+  return rc;
 }
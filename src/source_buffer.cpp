@@ -0,0 +1,48 @@
+#include "source_buffer.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+SourceBuffer SourceBuffer::fromFile(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open input file: " + filename);
+    }
+
+    SourceBuffer source;
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    if (size > 0) {
+        // One extra byte so a missing final '\n' can be added in place
+        source.text.reserve((size_t)size + 1);
+        source.text.resize((size_t)size);
+        file.read(&source.text[0], size);
+        source.text.resize((size_t)file.gcount());
+    }
+    file.close();
+
+    if (!source.text.empty() && source.text.back() != '\n') {
+        source.text.push_back('\n');
+    }
+
+    // Index the line starts
+    const char* base = source.text.data();
+    const char* end = base + source.text.size();
+    for (const char* p = base; p < end; ) {
+        source.starts.push_back(p - base);
+        p = (const char*)memchr(p, '\n', end - p) + 1;
+    }
+    return source;
+}
+
+void SourceBuffer::appendLine(const char* data, size_t length) {
+    starts.push_back(text.size());
+    text.append(data, length);
+    text.push_back('\n');
+}
+
+void SourceBuffer::reserve(size_t bytes, size_t lines) {
+    text.reserve(bytes);
+    starts.reserve(lines);
+}
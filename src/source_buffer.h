@@ -0,0 +1,39 @@
+#ifndef SOURCE_BUFFER_H
+#define SOURCE_BUFFER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Program text held in one contiguous buffer, with an index of where each
+// line starts. Lines are handed out as (pointer, length) views into the
+// buffer, so stages pass one buffer along instead of copying every line.
+// Line splitting follows std::getline: the '\n' is not part of the line and
+// a final line without one is still a line.
+class SourceBuffer {
+private:
+    std::string text;            // Every line followed by '\n'
+    std::vector<size_t> starts;  // Offset of each line in text
+
+public:
+    SourceBuffer() {}
+
+    // Reads the whole file at once; throws std::runtime_error if it can't
+    static SourceBuffer fromFile(const std::string& filename);
+
+    void appendLine(const char* data, size_t length);
+    void appendLine(const std::string& line) { appendLine(line.data(), line.size()); }
+    void reserve(size_t bytes, size_t lines);
+
+    size_t lineCount() const { return starts.size(); }
+    const char* lineData(size_t i) const { return text.data() + starts[i]; }
+    size_t lineLength(size_t i) const {
+        return (i + 1 < starts.size() ? starts[i + 1] : text.size()) - starts[i] - 1;
+    }
+    std::string line(size_t i) const { return std::string(lineData(i), lineLength(i)); }
+
+    // All lines, each followed by '\n'
+    const std::string& contents() const { return text; }
+};
+
+#endif // SOURCE_BUFFER_H
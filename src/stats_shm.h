@@ -0,0 +1,84 @@
+#ifndef STATS_SHM_H
+#define STATS_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+#include "isa.h"
+
+// Live counters of a run, published by simulador --stats-shm=name in a
+// POSIX shared-memory segment ("/name") and shown by sbtop.
+//
+// The simulator is the only writer. It updates the segment whenever vm_run
+// pauses, every few tens of thousands of steps, so the engines run
+// unchanged between updates. Readers use the seqlock in seq: it is odd
+// while an update is in progress, and a copy is only valid if seq was the
+// same even value before and after it (SbsStats_read).
+//
+// The opcode histogram in ops is exact when op_source is SBS_OPS_COUNTED:
+// the threaded engine counts straight-line runs on a verified image and the
+// simulator expands them into executions per opcode. Otherwise (switch or
+// jit engine, unverified image) it is SBS_OPS_SAMPLED: each update records
+// the opcode at PC, so ops[op] / samples estimates the share of steps.
+
+#define SBS_MAGIC "SBST"
+#define SBS_VERSION 2
+
+// SbsStats.state
+#define SBS_RUNNING 0u
+#define SBS_DONE 1u     // exit_status holds the vm_run result (0 = STOP)
+
+// SbsStats.op_source
+#define SBS_OPS_SAMPLED 0u
+#define SBS_OPS_COUNTED 1u
+
+struct SbsStats {
+    char magic[4];          // "SBST"
+    uint16_t version;       // SBS_VERSION
+    uint16_t size;          // sizeof(SbsStats)
+    uint32_t pid;           // simulator process
+    uint32_t state;         // SBS_RUNNING / SBS_DONE
+    uint64_t seq;           // seqlock counter
+    char program[64];       // program path (truncated)
+    uint64_t start_ns;      // CLOCK_MONOTONIC when the run started
+    uint64_t update_ns;     // CLOCK_MONOTONIC of the last update
+    uint64_t steps;         // steps executed (vm->cpu.steps)
+    uint64_t steps_per_sec; // over the last second or so
+    uint32_t pc;            // next instruction
+    int32_t acc;
+    uint64_t inputs;        // INPUTs executed
+    uint64_t outputs;       // OUTPUTs executed
+    uint64_t samples;       // SBS_OPS_SAMPLED: opcode samples, one per update
+    uint64_t ops[ISA_MAX_OPCODE + 1]; // executions or samples per opcode (0 = unknown)
+    int32_t exit_status;    // valid when state == SBS_DONE
+    uint32_t op_source;     // SBS_OPS_COUNTED / SBS_OPS_SAMPLED
+};
+
+static_assert(sizeof(SbsStats) == 160 + 8 * (ISA_MAX_OPCODE + 1), "SbsStats must have no padding");
+
+static inline void SbsStats_begin(SbsStats *s)
+{
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void SbsStats_end(SbsStats *s)
+{
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Consistent copy of *s into *out; 0 if the writer kept it busy.
+static inline int SbsStats_read(const SbsStats *s, SbsStats *out)
+{
+    for (int tries = 0; tries < 1000; ++tries) {
+        uint64_t before = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+        memcpy(out, (const void *)s, sizeof *out);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == before)
+            return 1;
+    }
+    return 0;
+}
+
+#endif // STATS_SHM_H
@@ -1,98 +1,188 @@
 #include "symbol_table.h"
+#include <algorithm>
 #include <iostream>
 
-SymbolTable::SymbolTable() {
+Interner::Interner() : table(64, -1) {
 }
 
-bool SymbolTable::addSymbol(const std::string& name, int address) {
-    if (symbols.find(name) != symbols.end() && symbols[name].defined) {
-        // Symbol already defined
-        return false;
+uint32_t Interner::hash(const char* s, size_t len) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
     }
-    
-    symbols[name] = Symbol(name, address, true);
-    return true;
+    return h;
 }
 
-bool SymbolTable::symbolExists(const std::string& name) const {
-    return symbols.find(name) != symbols.end();
+void Interner::grow() {
+    std::vector<int> bigger(table.size() * 2, -1);
+    size_t mask = bigger.size() - 1;
+    for (size_t id = 0; id < names.size(); id++) {
+        size_t i = hashes[id] & mask;
+        while (bigger[i] >= 0) {
+            i = (i + 1) & mask;
+        }
+        bigger[i] = (int)id;
+    }
+    table.swap(bigger);
 }
 
-bool SymbolTable::isSymbolDefined(const std::string& name) const {
-    auto it = symbols.find(name);
-    if (it != symbols.end()) {
-        return it->second.defined;
+int Interner::intern(const char* s, size_t len) {
+    uint32_t h = hash(s, len);
+    size_t mask = table.size() - 1;
+    size_t i = h & mask;
+    while (table[i] >= 0) {
+        int id = table[i];
+        if (hashes[id] == h && names[id].size() == len && names[id].compare(0, len, s, len) == 0) {
+            return id;
+        }
+        i = (i + 1) & mask;
+    }
+
+    int id = (int)names.size();
+    names.push_back(std::string(s, len));
+    hashes.push_back(h);
+    table[i] = id;
+    if (names.size() * 2 > table.size()) {
+        grow();
     }
-    return false;
+    return id;
 }
 
-int SymbolTable::getSymbolAddress(const std::string& name) const {
-    auto it = symbols.find(name);
-    if (it != symbols.end()) {
-        return it->second.address;
+int Interner::find(const std::string& s) const {
+    uint32_t h = hash(s.data(), s.size());
+    size_t mask = table.size() - 1;
+    for (size_t i = h & mask; table[i] >= 0; i = (i + 1) & mask) {
+        if (hashes[table[i]] == h && names[table[i]] == s) {
+            return table[i];
+        }
     }
     return -1;
 }
 
-void SymbolTable::defineSymbol(const std::string& name, int address) {
-    symbols[name] = Symbol(name, address, true);
+SymbolTable::SymbolTable() {
 }
 
-void SymbolTable::addPendingReference(int address, const std::string& symbol, int line) {
-    pending_references.push_back(PendingReference(address, symbol, line));
-    
-    // Add symbol to table if it doesn't exist (as undefined)
-    if (symbols.find(symbol) == symbols.end()) {
-        symbols[symbol] = Symbol(symbol, -1, false);
+Symbol& SymbolTable::at(int id) {
+    if (id >= (int)symbols.size()) {
+        symbols.resize(names.size());
+        undefined_pos.resize(names.size(), -1);
     }
+    return symbols[id];
 }
 
-const std::vector<PendingReference>& SymbolTable::getPendingReferences() const {
-    return pending_references;
+bool SymbolTable::isSymbolDefined(int id) const {
+    return id >= 0 && id < (int)symbols.size() && symbols[id].defined;
 }
 
-std::vector<std::pair<int, int>> SymbolTable::resolvePendingReferences() {
-    std::vector<std::pair<int, int>> resolutions;
-    
-    for (const auto& ref : pending_references) {
-        if (isSymbolDefined(ref.symbol_name)) {
-            int symbol_address = getSymbolAddress(ref.symbol_name);
-            resolutions.push_back({ref.instruction_address, symbol_address});
+int SymbolTable::getSymbolAddress(int id) const {
+    return isSymbolDefined(id) ? symbols[id].address : -1;
+}
+
+void SymbolTable::defineSymbol(int id, int address) {
+    Symbol& sym = at(id);
+    sym.address = address;
+    sym.defined = true;
+
+    // Leave the undefined set: swap with the last entry
+    int pos = undefined_pos[id];
+    if (pos >= 0) {
+        int last = undefined.back();
+        undefined[pos] = last;
+        undefined_pos[last] = pos;
+        undefined.pop_back();
+        undefined_pos[id] = -1;
+    }
+}
+
+int SymbolTable::reference(int id, int slot) {
+    Symbol& sym = at(id);
+    if (sym.defined) {
+        return sym.address;
+    }
+    if (!sym.referenced) {
+        sym.referenced = true;
+        undefined_pos[id] = (int)undefined.size();
+        undefined.push_back(id);
+    }
+    sym.chain.push_back(slot);
+    return -1;
+}
+
+std::vector<int> SymbolTable::takeChain(int id) {
+    std::vector<int> chain;
+    if (id < (int)symbols.size()) {
+        chain.swap(symbols[id].chain);
+    }
+    return chain;
+}
+
+std::vector<PendingReference> SymbolTable::getPendingReferences() const {
+    std::vector<PendingReference> pending;
+    for (int id : undefined) {
+        for (int slot : symbols[id].chain) {
+            pending.push_back(PendingReference(slot, names.name(id), 0));
         }
     }
-    
-    return resolutions;
+    std::sort(pending.begin(), pending.end(),
+              [](const PendingReference& a, const PendingReference& b) {
+                  return a.instruction_address < b.instruction_address;
+              });
+    return pending;
 }
 
 void SymbolTable::printSymbolTable() const {
     std::cout << "\nSymbol Table:\n";
     std::cout << "Name\t\tAddress\t\tDefined\n";
     std::cout << "----\t\t-------\t\t-------\n";
-    
-    for (const auto& pair : symbols) {
-        const Symbol& sym = pair.second;
-        std::cout << sym.name << "\t\t" << sym.address << "\t\t" 
+
+    std::vector<int> ids;
+    for (int id = 0; id < (int)symbols.size(); id++) {
+        if (symbols[id].defined || symbols[id].referenced) {
+            ids.push_back(id);
+        }
+    }
+    std::sort(ids.begin(), ids.end(), [this](int a, int b) { return names.name(a) < names.name(b); });
+    for (int id : ids) {
+        const Symbol& sym = symbols[id];
+        std::cout << names.name(id) << "\t\t" << sym.address << "\t\t"
                   << (sym.defined ? "Yes" : "No") << "\n";
     }
-    
-    if (!pending_references.empty()) {
+
+    std::vector<PendingReference> pending = getPendingReferences();
+    if (!pending.empty()) {
         std::cout << "\nPending References:\n";
-        for (const auto& ref : pending_references) {
-            std::cout << "Address " << ref.instruction_address 
-                      << " references " << ref.symbol_name 
+        for (const auto& ref : pending) {
+            std::cout << "Address " << ref.instruction_address
+                      << " references " << ref.symbol_name
                       << " (line " << ref.line_number << ")\n";
         }
     }
 }
 
 std::vector<std::string> SymbolTable::getUndefinedSymbols() const {
-    std::vector<std::string> undefined;
-    
-    for (const auto& pair : symbols) {
-        if (!pair.second.defined) {
-            undefined.push_back(pair.first);
+    std::vector<std::string> result;
+    result.reserve(undefined.size());
+    for (int id : undefined) {
+        result.push_back(names.name(id));
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<std::pair<std::string, int>> SymbolTable::getDefinedSymbols() const {
+    std::vector<std::pair<std::string, int>> defined;
+
+    for (int id = 0; id < (int)symbols.size(); id++) {
+        if (symbols[id].defined) {
+            defined.push_back({names.name(id), symbols[id].address});
         }
     }
-    
-    return undefined;
+
+    // Sorted by address, so a debugger can find the label at or before a PC
+    std::sort(defined.begin(), defined.end(),
+              [](const std::pair<std::string, int>& a, const std::pair<std::string, int>& b) {
+                  return a.second != b.second ? a.second < b.second : a.first < b.first;
+              });
+    return defined;
 }
@@ -1,54 +1,86 @@
 #ifndef SYMBOL_TABLE_H
 #define SYMBOL_TABLE_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
-#include <map>
 #include <vector>
 
+// Identifiers interned once, at lex time, into dense IDs 0, 1, 2, ...
+// Open addressing with linear probing over a power-of-two table kept at
+// most half full; every later stage works on the IDs.
+class Interner {
+private:
+    std::vector<std::string> names;   // ID -> identifier
+    std::vector<uint32_t> hashes;     // ID -> hash, so growing never rehashes strings
+    std::vector<int> table;           // -1 = empty slot, otherwise an ID
+
+    static uint32_t hash(const char* s, size_t len);
+    void grow();
+
+public:
+    Interner();
+
+    int intern(const char* s, size_t len);
+    int intern(const std::string& s) { return intern(s.data(), s.size()); }
+    int find(const std::string& s) const;  // -1 if never interned
+    const std::string& name(int id) const { return names[id]; }
+    int size() const { return (int)names.size(); }
+};
+
 struct Symbol {
-    std::string name;
     int address;
     bool defined;
-    
-    Symbol() : address(-1), defined(false) {}
-    Symbol(const std::string& n, int addr, bool def) 
-        : name(n), address(addr), defined(def) {}
+    bool referenced;         // In the undefined set while referenced and not defined
+    std::vector<int> chain;  // Object-code slots waiting for the address (backpatch chain)
+
+    Symbol() : address(-1), defined(false), referenced(false) {}
 };
 
 struct PendingReference {
     int instruction_address;  // Address where the reference occurs
     std::string symbol_name;  // Name of the referenced symbol
     int line_number;          // Line number for error reporting
-    
+
     PendingReference(int addr, const std::string& sym, int line)
         : instruction_address(addr), symbol_name(sym), line_number(line) {}
 };
 
 class SymbolTable {
 private:
-    std::map<std::string, Symbol> symbols;
-    std::vector<PendingReference> pending_references;
-    
+    Interner names;
+    std::vector<Symbol> symbols;      // Indexed by ID
+    std::vector<int> undefined;       // IDs referenced but not (yet) defined
+    std::vector<int> undefined_pos;   // ID -> position in undefined, -1 if absent
+
+    Symbol& at(int id);
+
 public:
     SymbolTable();
-    
+
+    // Identifiers (the lexer interns through here)
+    Interner& getInterner() { return names; }
+    const std::string& name(int id) const { return names.name(id); }
+
     // Symbol management
-    bool addSymbol(const std::string& name, int address);
-    bool symbolExists(const std::string& name) const;
-    bool isSymbolDefined(const std::string& name) const;
-    int getSymbolAddress(const std::string& name) const;
-    void defineSymbol(const std::string& name, int address);
-    
-    // Pending references
-    void addPendingReference(int address, const std::string& symbol, int line);
-    const std::vector<PendingReference>& getPendingReferences() const;
-    
-    // Resolution
-    std::vector<std::pair<int, int>> resolvePendingReferences();
-    
+    bool isSymbolDefined(int id) const;
+    int getSymbolAddress(int id) const;
+    void defineSymbol(int id, int address);
+
+    // References: the symbol's address, or -1 after adding the slot to its
+    // backpatch chain (the slot is patched when the symbol gets defined)
+    int reference(int id, int slot);
+    // Slots waiting for a symbol that was just defined; the chain is emptied
+    std::vector<int> takeChain(int id);
+    // Slots still waiting for undefined symbols, in slot order
+    std::vector<PendingReference> getPendingReferences() const;
+
     // Debugging
     void printSymbolTable() const;
+    // Names in alphabetical order; cost depends only on the undefined count
     std::vector<std::string> getUndefinedSymbols() const;
+    // Sorted by address, then name
+    std::vector<std::pair<std::string, int>> getDefinedSymbols() const;
 };
 
 #endif // SYMBOL_TABLE_H
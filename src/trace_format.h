@@ -0,0 +1,50 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <stdint.h>
+
+// Binary execution trace (.sbt), written by simulador --trace-file and
+// decoded by sbtrace.
+//
+// Layout (host byte order, little-endian on the supported hosts):
+//   SbtHeader          fixed 32-byte header
+//   SbtRecord[]        records in execution order
+
+#define SBT_MAGIC "SBTR"
+#define SBT_VERSION 1
+
+// SbtHeader.flags
+#define SBT_RING 1u  // only the last records were kept (--trace-last)
+
+// Largest PC a record can hold: traces need MEM_SIZE <= 65536
+#define SBT_MAX_PC 0xFFFFu
+
+// SbtRecord.flags
+#define SBT_READ 1u   // value was read from mem[addr]
+#define SBT_WRITE 2u  // value was written to mem[addr]
+#define SBT_JUMP 4u   // addr is a jump target
+
+struct SbtHeader {
+    char magic[4];          // "SBTR"
+    uint16_t version;       // SBT_VERSION
+    uint16_t record_size;   // sizeof(SbtRecord)
+    uint32_t flags;         // SBT_RING
+    uint32_t every;         // sampling period in steps (1 = every step)
+    uint64_t total;         // records produced (after PC range and sampling)
+    uint64_t written;       // records stored in the file
+};
+
+struct SbtRecord {
+    uint64_t step;          // 1-based step number
+    uint16_t pc;            // up to SBT_MAX_PC
+    uint8_t op;             // opcode at pc
+    uint8_t flags;          // SBT_READ / SBT_WRITE / SBT_JUMP
+    int32_t acc;            // ACC before the instruction
+    uint32_t addr;          // effective address (COPY: destination)
+    int32_t value;          // value read or written
+};
+
+static_assert(sizeof(SbtHeader) == 32, "SbtHeader must have no padding");
+static_assert(sizeof(SbtRecord) == 24, "SbtRecord must have no padding");
+
+#endif // TRACE_FORMAT_H